@@ -0,0 +1,87 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_COMPLETION_QUEUE_HPP_INCLUDED_
+#define _COCAINE_DEALER_COMPLETION_QUEUE_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+
+#include <cocaine/dealer/forwards.hpp>
+#include <cocaine/dealer/response_handler.hpp>
+#include <cocaine/dealer/utils/data_container.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+enum e_completion_event_type {
+	COMPLETION_CHUNK = 1,
+	COMPLETION_DONE,
+	COMPLETION_ERROR
+};
+
+class completion_event_t {
+public:
+	completion_event_t() :
+		tag(NULL),
+		type(COMPLETION_CHUNK),
+		error_code(0) {}
+
+	// tag the response was registered with
+	void*			tag;
+	int				type;
+
+	// for COMPLETION_CHUNK
+	data_container	data;
+
+	// for COMPLETION_ERROR
+	int				error_code;
+	std::string		error_message;
+};
+
+// lets one thread wait for events of many responses at once:
+// pass handler(tag) to dealer_t::send_message() for each request,
+// then collect chunks and completions with wait()
+class completion_queue_t : private boost::noncopyable {
+public:
+	completion_queue_t();
+	virtual ~completion_queue_t();
+
+	response_handler_t handler(void* tag);
+
+	// timeout in seconds, < 0 - block until there are events, 0 - don't block.
+	// max_events == 0 means no limit. returns number of events appended
+	size_t wait(std::vector<completion_event_t>& events,
+				double timeout = -1.0,
+				size_t max_events = 0);
+
+	size_t size() const;
+
+private:
+	boost::shared_ptr<completion_queue_impl_t> m_impl;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_COMPLETION_QUEUE_HPP_INCLUDED_
@@ -21,27 +21,36 @@
 #ifndef _COCAINE_DEALER_BALANCER_HPP_INCLUDED_
 #define _COCAINE_DEALER_BALANCER_HPP_INCLUDED_
 
+#include <map>
 #include <vector>
 #include <string>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
 #include <boost/ptr_container/ptr_vector.hpp>
 
 #include <zmq.hpp>
 
+#include "cocaine/dealer/defaults.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/response_chunk.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
 
 namespace cocaine {
 namespace dealer {
 
 class balancer_t : private boost::noncopyable, public dealer_object_t {
 public:
+	// number of unfinished messages sent to route
+	typedef boost::function<size_t(const std::string&)> outstanding_counter_t;
+
+	// io_affinity is a zmq io threads bitmask, 0 lets zmq choose
 	balancer_t(const std::string& identity,
 			   const std::set<cocaine_endpoint_t>& endpoints,
 			   const boost::shared_ptr<context_t>& ctx,
+			   uint64_t io_affinity = 0,
 			   bool logging_enabled = true);
 
 	virtual ~balancer_t();
@@ -49,11 +58,41 @@ public:
 	void update_endpoints(const std::set<cocaine_endpoint_t>& endpoints,
 						  std::set<cocaine_endpoint_t>& missing_endpoints);
 
+	// round robin is used until outstanding counter is set
+	void set_balancing_policy(enum e_balancing_policy policy,
+							  const outstanding_counter_t& counter);
+
 	bool send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t& endpoint);
+
+	// last send failed because every endpoint has its in-flight window full
+	bool is_saturated() const;
+
+	// no endpoint is in rotation, send fails until one comes back
+	bool has_alive_endpoints() const;
+
+	// speculative copy of sent message, to another endpoint than excluded_route
+	bool send_hedge(boost::shared_ptr<message_iface>& message,
+					const std::string& excluded_route,
+					cocaine_endpoint_t& endpoint);
+
+	// latencies are measured from message send, in seconds
+	void update_ack_latency(const std::string& route, double latency);
+	void update_choke_latency(const std::string& route, double latency);
+
+	// outcomes of messages sent to route, endpoints with many consecutive
+	// failures are ejected from rotation for a while and then probed
+	// with a single message to get back, only that message's outcome
+	// decides whether endpoint gets back
+	void report_success(const std::string& route, const wuuid_t& uuid);
+	void report_failure(const std::string& route, const wuuid_t& uuid);
+
 	bool receive(boost::shared_ptr<response_chunk_t>& response);
 
 	bool check_for_responses(int poll_timeout) const;
 
+	// underlying socket descriptor for event loop
+	int fd() const;
+
 	static const int socket_timeout = 0;
 
 	#if ZMQ_VERSION_MAJOR < 3
@@ -70,12 +109,132 @@ private:
 
 	cocaine_endpoint_t& get_next_endpoint();
 
+	// balances over candidates until endpoint with route not in the list
+	// comes up, false if none did and last picked endpoint is current
+	bool next_endpoint_excluding(const std::vector<std::string>& excluded_routes);
+
+	// candidate endpoint that didn't fail, or the one that failed longest
+	// ago (failed routes are ordered most recent last), sets
+	// m_current_endpoint_index to it, true if it has failed too
+	bool least_recently_failed_endpoint(const std::vector<std::string>& failed_routes);
+
+	// alive endpoints having room in their in-flight windows, unfinished
+	// messages are counted by outstanding counter, so windows need it
+	void update_open_endpoints();
+
+	// endpoints balancing policies choose from
+	const std::vector<size_t>& candidate_endpoints() const;
+
+	// writes message frames to the endpoint at m_current_endpoint_index
+	bool send_to_current_endpoint(boost::shared_ptr<message_iface>& message);
+
+	// every one of these sets m_current_endpoint_index to chosen endpoint
+	cocaine_endpoint_t& round_robin_endpoint();
+	cocaine_endpoint_t& least_outstanding_endpoint();
+	cocaine_endpoint_t& power_of_two_endpoint();
+	cocaine_endpoint_t& latency_endpoint();
+
+	// picks ejected endpoint whose time to be probed came,
+	// sets m_current_endpoint_index to it
+	bool probe_endpoint();
+
+	// rendezvous hashing of key over alive endpoints, endpoint weights are
+	// not taken into account, as they change with load and would move keys
+	cocaine_endpoint_t& keyed_endpoint(const std::string& routing_key);
+
+	// two distinct random alive endpoints
+	void random_endpoints_pair(size_t& first, size_t& second);
+
+	// averaged latency of endpoint, 0 if not measured yet
+	double endpoint_latency(size_t index) const;
+
+	// expected latency of endpoint given its unfinished messages and weight
+	double latency_cost(size_t index, double latency) const;
+
+	// whether endpoint a is less loaded than endpoint b, relative to weights
+	bool less_loaded(size_t a, size_t b) const;
+
+	// rebuilds endpoints vector and serialized route frames from endpoints set
+	void rebuild_endpoints();
+
+	// alive endpoints are ones with positive weight and closed circuit
+	void rebuild_alive_endpoints();
+
+	// policy is always packed as [bool, double, double], so the frame has
+	// fixed size and layout and is filled in without msgpack encoder
+	static const size_t policy_frame_size = 20;
+	static void pack_policy(const policy_t& policy, unsigned char* frame);
+
+	// zmq free callback for zero-copy data, drops reference to data container
+	static void release_data(void* data, void* hint);
+
 private:
 	boost::shared_ptr<zmq::socket_t>	m_socket;
 	std::set<cocaine_endpoint_t>		m_endpoints;
 	std::vector<cocaine_endpoint_t>		m_endpoints_vec;
+
+	// msgpack-serialized routes, same order as m_endpoints_vec
+	std::vector<std::string>			m_route_frames;
+
+	// hashes of endpoint routes for keyed routing, parallel to m_endpoints_vec
+	std::vector<uint64_t>				m_route_hashes;
+
+	// smooth weighted round-robin state, parallel to m_endpoints_vec
+	std::vector<double>					m_current_weights;
+
+	// indices of endpoints in rotation
+	std::vector<size_t>					m_alive_endpoints;
+
+	// alive endpoints with room in their windows, as of last send
+	std::vector<size_t>					m_open_endpoints;
+	bool								m_windows_enabled;
+	bool								m_saturated;
+
+	enum e_circuit_state {
+		CIRCUIT_CLOSED = 1,
+
+		// ejected until probe time
+		CIRCUIT_OPEN,
+
+		// probe message sent, waiting for its outcome until probe time
+		CIRCUIT_HALF_OPEN
+	};
+
+	struct circuit_t {
+		circuit_t() : state(CIRCUIT_CLOSED), failures(0), ejections(0), probe_time(0.0) {}
+
+		int		state;
+
+		// consecutive failed messages and ejections
+		int		failures;
+		int		ejections;
+		double	probe_time;
+
+		// message sent as probe while half open
+		wuuid_t	probe_uuid;
+	};
+
+	// only routes that failed since their last success are here
+	std::map<std::string, circuit_t>	m_circuits;
+	size_t								m_ejected_count;
+	double								m_next_probe_time;
+
+	// moving averages of route latencies, ack is used until choke one is known
+	struct latency_stats_t {
+		latency_stats_t() : ack(0.0), choke(0.0) {}
+
+		double ack;
+		double choke;
+	};
+
+	std::map<std::string, latency_stats_t>	m_latencies;
+
+	enum e_balancing_policy				m_balancing_policy;
+	outstanding_counter_t				m_outstanding_counter;
+	unsigned int						m_random_seed;
 	size_t								m_current_endpoint_index;
 	std::string							m_socket_identity;
+	uint64_t							m_io_affinity;
 };
 
 } // namespace dealer
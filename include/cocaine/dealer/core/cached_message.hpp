@@ -22,6 +22,8 @@
 #define _COCAINE_DEALER_CACHED_MESSAGE_HPP_INCLUDED_
 
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <sys/time.h>
 #include <cstring>
 #include <iomanip>
@@ -45,6 +47,18 @@
 namespace cocaine {
 namespace dealer {
 
+namespace detail {
+	// only plain containers are shared, persistent ones unload their data
+	inline bool share_data(const data_container& src, data_container& dst) {
+		dst = src;
+		return true;
+	}
+
+	template<typename T> inline bool share_data(const T&, data_container&) {
+		return false;
+	}
+}
+
 template<typename DataContainer, typename MetadataContainer>
 class cached_message_t : public message_iface {
 public:
@@ -64,6 +78,8 @@ public:
 	void* data();
 	size_t size() const;
 
+	bool share_data(dealer::data_container& data);
+
 	DataContainer& data_container();
 	MetadataContainer& mdata_container();
 
@@ -81,6 +97,12 @@ public:
 	const std::string& destination_endpoint() const;
 	void set_destination_endpoint(const std::string& value);
 
+	const std::string& destination_route() const;
+	void set_destination_route(const std::string& value);
+
+	const std::string& reply_route() const;
+	void set_reply_route(const std::string& value);
+
 	void mark_as_sent(bool value);
 
 	bool is_expired();
@@ -101,6 +123,9 @@ public:
 	void increment_retries_count();
 	bool can_retry() const;
 
+	const std::vector<std::string>& failed_routes() const;
+	void add_failed_route(const std::string& route);
+
 	void remove_from_persistent_cache();
 
 	void commit_to_eblob(boost::shared_ptr<eblob_t>& blob);
@@ -190,6 +215,25 @@ cached_message_t<DataContainer, MetadataContainer>::can_retry() const {
 	return (m_metadata.retries_count < m_metadata.policy.max_retries ? true : false);
 }
 
+template<typename DataContainer, typename MetadataContainer> const std::vector<std::string>&
+cached_message_t<DataContainer, MetadataContainer>::failed_routes() const {
+	return m_metadata.failed_routes;
+}
+
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::add_failed_route(const std::string& route) {
+	std::vector<std::string>& routes = m_metadata.failed_routes;
+
+	routes.erase(std::remove(routes.begin(), routes.end(), route), routes.end());
+	routes.push_back(route);
+
+	// only the most recent failures are remembered, older ones
+	// might have been temporary
+	if (routes.size() > MetadataContainer::max_failed_routes) {
+		routes.erase(routes.begin());
+	}
+}
+
 template<typename DataContainer, typename MetadataContainer> bool
 cached_message_t<DataContainer, MetadataContainer>::is_data_loaded() {
 	return m_data.is_data_loaded();
@@ -215,6 +259,11 @@ cached_message_t<DataContainer, MetadataContainer>::size() const {
 	return m_data.size();
 }
 
+template<typename DataContainer, typename MetadataContainer> bool
+cached_message_t<DataContainer, MetadataContainer>::share_data(dealer::data_container& data) {
+	return detail::share_data(m_data, data);
+}
+
 template<typename DataContainer, typename MetadataContainer> DataContainer&
 cached_message_t<DataContainer, MetadataContainer>::data_container() {
 	return m_data;
@@ -309,6 +358,26 @@ cached_message_t<DataContainer, MetadataContainer>::set_destination_endpoint(con
 	m_metadata.destination_endpoint = value;	
 }
 
+template<typename DataContainer, typename MetadataContainer> const std::string&
+cached_message_t<DataContainer, MetadataContainer>::destination_route() const {
+	return m_metadata.destination_route;
+}
+
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::set_destination_route(const std::string& value) {
+	m_metadata.destination_route = value;
+}
+
+template<typename DataContainer, typename MetadataContainer> const std::string&
+cached_message_t<DataContainer, MetadataContainer>::reply_route() const {
+	return m_metadata.reply_route;
+}
+
+template<typename DataContainer, typename MetadataContainer> void
+cached_message_t<DataContainer, MetadataContainer>::set_reply_route(const std::string& value) {
+	m_metadata.reply_route = value;
+}
+
 template<typename DataContainer, typename MetadataContainer> const message_path_t&
 cached_message_t<DataContainer, MetadataContainer>::path() const {
 	return m_metadata.path();
@@ -328,6 +397,7 @@ cached_message_t<DataContainer, MetadataContainer>::mark_as_sent(bool value) {
 	else {
 		m_metadata.is_sent = false;
 		m_metadata.sent_timestamp.reset();
+		m_metadata.reply_route.clear();
 	}
 }
 
@@ -33,12 +33,18 @@ namespace dealer {
  // predeclaration
 struct cocaine_endpoint_t {
 public:
-	cocaine_endpoint_t() {}
-
-	cocaine_endpoint_t(const std::string& endpoint_, const std::string& route_, int weight_ = 0) :
+	cocaine_endpoint_t() :
+		weight(0.0),
+		window(0) {}
+
+	cocaine_endpoint_t(const std::string& endpoint_,
+					   const std::string& route_,
+					   double weight_ = 0.0,
+					   size_t window_ = 0) :
 		endpoint(endpoint_),
 		route(route_),
-		weight(weight_) {}
+		weight(weight_),
+		window(window_) {}
 
 	~cocaine_endpoint_t() {}
 
@@ -46,6 +52,7 @@ public:
 		endpoint(rhs.endpoint),
 		route(rhs.route),
 		weight(rhs.weight),
+		window(rhs.window),
 		announce_timer(rhs.announce_timer) {}
 
 	cocaine_endpoint_t& operator = (const cocaine_endpoint_t& rhs) {
@@ -53,6 +60,7 @@ public:
 			endpoint = rhs.endpoint;
 			route = rhs.route;
 			weight = rhs.weight;
+			window = rhs.window;
 			announce_timer = rhs.announce_timer;
 		}
 
@@ -77,6 +85,7 @@ public:
 		str += "endpoint: " + endpoint + ", ";
 		str += "route: " + route + ", ";
 		str += "weight: " + boost::lexical_cast<std::string>(weight) + ", ";
+		str += "window: " + boost::lexical_cast<std::string>(window) + ", ";
 		str += "announce: " + announce_timer.started_at().as_string();
 
 		return str;
@@ -84,7 +93,11 @@ public:
 
 	std::string		endpoint;
 	std::string		route;
-	int				weight;
+	// relative capacity, 0 for dead endpoint
+	double			weight;
+
+	// max unfinished messages sent there, 0 for unlimited
+	size_t			window;
 	progress_timer	announce_timer;
 };
 
@@ -0,0 +1,73 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_CONCURRENCY_LIMITER_HPP_INCLUDED_
+#define _COCAINE_DEALER_CONCURRENCY_LIMITER_HPP_INCLUDED_
+
+#include <cstddef>
+
+#include <boost/utility.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+// adaptive limit of unfinished messages, gradient algorithm: the limit
+// shrinks as recent latency grows above no-load (minimal) one and grows
+// by about sqrt(limit) while they match; not thread-safe, owner synchronizes
+class concurrency_limiter_t : private boost::noncopyable {
+public:
+	concurrency_limiter_t(size_t initial_limit, size_t min_limit, size_t max_limit);
+	virtual ~concurrency_limiter_t();
+
+	// false if limit is reached
+	bool try_acquire();
+
+	// message finished in latency seconds, dropped ones (timed out or
+	// rejected by overloaded node) cut the limit right away
+	void release(double latency, bool dropped);
+
+	size_t limit() const;
+	size_t inflight() const;
+
+private:
+	void reset_window();
+
+private:
+	// latencies are averaged over windows of this many messages
+	static const size_t window_size = 16;
+
+	double	m_limit;
+	size_t	m_min_limit;
+	size_t	m_max_limit;
+	size_t	m_inflight;
+
+	double	m_min_latency;
+	size_t	m_min_latency_age;
+	double	m_window_latency_sum;
+	size_t	m_window_samples;
+
+	// to tell whether limit was actually reached during window
+	size_t	m_window_max_inflight;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_CONCURRENCY_LIMITER_HPP_INCLUDED_
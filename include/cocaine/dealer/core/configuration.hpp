@@ -23,6 +23,7 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <iostream>
 
 #include <boost/thread/mutex.hpp>
@@ -59,6 +60,12 @@ public:
 	enum e_message_cache_type message_cache_type() const;
 	float endpoint_timeout() const;
 
+	int io_threads_count() const;
+	const std::vector<int>& io_threads_cpus() const;
+	int dispatch_threads_count() const;
+	const std::vector<int>& dispatch_threads_cpus() const;
+	enum e_dispatch_sharding dispatch_sharding() const;
+
 	enum e_logger_type logger_type() const;
 	unsigned int logger_flags() const;
 	const std::string& logger_file_path() const;
@@ -84,6 +91,8 @@ public:
 private:
 	void parse_basic_settings(const Json::Value& config_value);
 	void parse_logger_settings(const Json::Value& config_value);
+	void parse_dispatch_settings(const Json::Value& config_value);
+	void parse_cpus_list(const Json::Value& cpus_value, std::vector<int>& cpus);
 	void parse_persistant_storage_settings(const Json::Value& config_value);
 	void parse_statistics_settings(const Json::Value& config_value);
 	void parse_services_settings(const Json::Value& config_value);
@@ -102,6 +111,13 @@ private:
 	std::string			m_logger_file_path;
 	std::string			m_logger_syslog_identity;
 
+	// dispatch
+	int							m_io_threads_count;
+	std::vector<int>			m_io_threads_cpus;
+	int							m_dispatch_threads_count;
+	std::vector<int>			m_dispatch_threads_cpus;
+	enum e_dispatch_sharding	m_dispatch_sharding;
+
 	// persistent storage
 	std::string m_eblob_path;
 	uint64_t	m_eblob_blob_size;
@@ -39,6 +39,8 @@ namespace cocaine {
 namespace dealer {
 
 class eblob_storage_t;
+class reactor_t;
+class reactor_worker_t;
 
 class context_t : private boost::noncopyable, public boost::enable_shared_from_this<context_t> {
 public:
@@ -53,6 +55,10 @@ public:
 	boost::shared_ptr<configuration_t> config();
 	boost::shared_ptr<zmq::context_t> zmq_context();
 	boost::shared_ptr<eblob_storage_t> storage();
+	boost::shared_ptr<reactor_t> reactor();
+
+	// thread response handler callbacks run on, unless handler has executor
+	boost::shared_ptr<reactor_worker_t> callbacks_worker();
     //boost::shared_ptr<statistics_collector> stats();
 
 private:
@@ -60,6 +66,8 @@ private:
 	boost::shared_ptr<base_logger_t> m_logger;
 	boost::shared_ptr<configuration_t> m_config;
 	boost::shared_ptr<eblob_storage_t> m_storage;
+	boost::shared_ptr<reactor_t> m_reactor;
+	boost::shared_ptr<reactor_worker_t> m_callbacks_worker;
     //boost::shared_ptr<statistics_collector> m_stats;
 };
 
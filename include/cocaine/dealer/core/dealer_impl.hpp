@@ -68,7 +68,8 @@ public:
 	send_message(const void* data,
 				 size_t size,
 				 const message_path_t& path,
-				 const message_policy_t& policy);
+				 const message_policy_t& policy,
+				 const response_handler_t& handler = response_handler_t());
 
 	response_ptr_t
 	send_message(const void* data,
@@ -87,12 +88,35 @@ public:
 				  size_t size,
 				  const message_path_t& path);
 
+	response_future_t
+	async_send_message(const void* data,
+					   size_t size,
+					   const message_path_t& path,
+					   const message_policy_t& policy);
+
+	std::vector<response_future_t>
+	async_send_messages(const void* data,
+						size_t size,
+						const message_path_t& path,
+						const message_policy_t& policy);
+
+	responses_list_t
+	send_batch(const std::vector<message_t>& messages);
+
 	boost::shared_ptr<message_iface>
 	create_message(const void* data,
 				   size_t size,
 				   const message_path_t& path,
 				   const message_policy_t& policy);
 
+	// eb is storage to commit message to, none for non-persistent message
+	boost::shared_ptr<message_iface>
+	create_message(const void* data,
+				   size_t size,
+				   const message_path_t& path,
+				   const message_policy_t& policy,
+				   boost::shared_ptr<eblob_t> eb);
+
 	message_policy_t policy_for_service(const std::string& service_alias);
 
 	size_t stored_messages_count(const std::string& service_alias);
@@ -122,13 +146,13 @@ private:
 
 	size_t m_messages_cache_size;
 
-	// dealer service name mapped to service
+	// dealer service name mapped to service, filled once in constructor
+	// and only read afterwards, so lookups don't need a lock
 	services_map_t m_services;
 
 	std::auto_ptr<overseer_t> m_overseer;
 
 	// synchronization
-	boost::mutex m_mutex;
 	boost::mutex m_regex_mutex;
 
 	// alive state
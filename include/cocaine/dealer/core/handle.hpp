@@ -23,11 +23,16 @@
 
 #include <string>
 #include <map>
+#include <vector>
 #include <memory>
+#include <atomic>
+#include <stdexcept>
 #include <cerrno>
 
 #include <zmq.hpp>
 
+#include <ev++.h>
+
 #include <msgpack.hpp>
 
 #include <boost/shared_ptr.hpp>
@@ -43,6 +48,7 @@
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/message_cache.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
+#include "cocaine/dealer/core/reactor.hpp"
 #include "cocaine/dealer/response_chunk.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
 #include "cocaine/dealer/utils/progress_timer.hpp"
@@ -92,7 +98,33 @@ public:
 	void kill();
 
 private:
-	void dispatch_messages();
+	// attaching to shared dispatch thread
+	void attach();
+	void detach();
+	void wake_up();
+	void update_deadline_timer();
+
+	// event loop callbacks
+	void on_socket_event(ev::io& watcher, int type);
+	void on_prepare(ev::prepare& watcher, int type);
+	void on_wakeup(ev::async& watcher, int type);
+	void on_control_event(ev::io& watcher, int type);
+	void on_deadline_timer(ev::timer& watcher, int type);
+
+	// watchers are set up with this wrapper around callback, exceptions
+	// must not unwind through libev and kill the shared dispatch thread
+	template<typename Watcher, void (handle_t::*callback)(Watcher&, int)>
+	void guarded_callback(Watcher& watcher, int type) {
+		try {
+			(this->*callback)(watcher, type);
+		}
+		catch (const std::exception& ex) {
+			log(PLOG_ERROR, "dispatch callback failed for %s, details: %s", description().c_str(), ex.what());
+		}
+		catch (...) {
+			log(PLOG_ERROR, "dispatch callback failed for %s, details: unknown error", description().c_str());
+		}
+	}
 
 	// working with control messages
 	void dispatch_control_messages(int type, balancer_t& balancer);
@@ -103,8 +135,21 @@ private:
 	// working with messages
 	bool dispatch_next_available_message(balancer_t& balancer);
 	void dispatch_next_available_response(balancer_t& balancer);
+
+	// seconds passed since message was last sent
+	static double time_since_sent(const boost::shared_ptr<message_iface>& message);
+
 	void process_deadlined_messages();
 
+	// hedging, delay is 0 when message should not be hedged
+	double hedge_delay(const message_policy_t& policy);
+	void hedge_message(boost::shared_ptr<message_iface>& message);
+
+	// whether response comes from the copy of message whose replies are
+	// passed on, the first copy to reply is chosen
+	bool claim_reply_route(const boost::shared_ptr<response_chunk_t>& response);
+	void add_reply_latency(double latency);
+
 	// working with responces
 	void enqueue_response(boost::shared_ptr<response_chunk_t>& response);
 	void remove_from_persistent_storage(const boost::shared_ptr<response_chunk_t>& response);
@@ -113,9 +158,8 @@ private:
 										const std::string& alias);
 private:
 	handle_info_t		m_info;
-	boost::thread		m_thread;
 	boost::mutex		m_mutex;
-	volatile bool		m_is_running;
+	std::atomic<bool>	m_is_running;
 	volatile bool		m_is_connected;
 
 	std::set<cocaine_endpoint_t>		m_endpoints;
@@ -124,11 +168,35 @@ private:
 	std::auto_ptr<zmq::socket_t> m_zmq_control_socket;
 	bool m_receiving_control_socket_ok;
 
-	responce_callback_t m_response_callback;
+	// dispatch thread this handle is attached to, everything
+	// below except m_wakeup is only touched from inside it
+	reactor_t::worker_ptr_t	m_worker;
+	std::auto_ptr<balancer_t>	m_balancer;
+	socket_ptr_t				m_control_socket;
+
+	std::unique_ptr<ev::io>			m_socket_watcher;
+	std::unique_ptr<ev::prepare>	m_prepare;
+	std::unique_ptr<ev::async>		m_wakeup;
+	std::unique_ptr<ev::io>			m_control_watcher;
+	std::unique_ptr<ev::timer>		m_deadline_timer;
+	double							m_deadline_timer_expiration;
+
+	// ring of recent send to choke latencies, for hedging by percentile
+	std::vector<double>	m_reply_latencies;
+	size_t				m_reply_latencies_next;
+
+	// percentile is recomputed every few new latencies only,
+	// not for every sent message
+	double				m_hedge_percentile;
+	double				m_hedge_percentile_delay;
+	size_t				m_reply_latencies_added;
+	std::vector<double>	m_sorted_latencies;
+
+	static const size_t reply_latencies_size = 128;
+	static const size_t min_reply_latencies = 16;
+	static const size_t hedge_recompute_interval = 16;
 
-	progress_timer m_last_response_timer;
-	progress_timer m_deadlined_messages_timer;
-	progress_timer m_control_messages_timer;
+	responce_callback_t m_response_callback;
 };
 
 } // namespace dealer
@@ -25,9 +25,13 @@
 #include <memory>
 #include <map>
 #include <list>
+#include <set>
+#include <queue>
+#include <vector>
+#include <functional>
 
 #include <boost/shared_ptr.hpp>
-#include <boost/thread/mutex.hpp>
+#include <boost/weak_ptr.hpp>
 
 #include <eblob/eblob.hpp>
 
@@ -35,11 +39,15 @@
 #include "cocaine/dealer/core/context.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
+#include "cocaine/dealer/core/sent_messages_index.hpp"
 #include "cocaine/dealer/utils/uuid.hpp"
 
 namespace cocaine {
 namespace dealer {
 
+// enqueue() and append_message_queue() can be called from any thread,
+// everything else — only from the handle dispatch thread, or after
+// the handle was killed
 class message_cache_t : private boost::noncopyable, public dealer_object_t {
 public:
 	typedef boost::shared_ptr<message_iface> cached_message_ptr_t;
@@ -48,12 +56,6 @@ public:
 	typedef std::pair<std::string, message_path_t> message_data_t;
 	typedef std::vector<message_data_t> expired_messages_data_t;
 
-	// <uuid, sent message>
-	typedef std::map<std::string, cached_message_ptr_t> sent_messages_map_t; 
-
-	// <route, sent messages map>
-	typedef std::map<std::string, sent_messages_map_t> route_sent_messages_map_t;
-
 public:
 	message_cache_t(const boost::shared_ptr<context_t>& ctx,
 					bool logging_enabled = true);
@@ -65,6 +67,7 @@ public:
 
 	size_t new_messages_count();
 	size_t sent_messages_count();
+	size_t sent_messages_count_for_route(const std::string& route) const;
 
 	void enqueue_with_priority(const boost::shared_ptr<message_iface>& message);
 	cached_message_ptr_t get_new_message();
@@ -74,29 +77,109 @@ public:
 						  boost::shared_ptr<message_iface>& message);
 
 	message_queue_ptr_t new_messages();
-	void move_new_message_to_sent(const std::string& route);
+
+	// hedge_delay > 0 makes message a hedging candidate after that time
+	void move_new_message_to_sent(const std::string& route, double hedge_delay = 0.0);
+
+	// speculative copy of sent message was sent to another route
+	void add_hedged_message(const std::string& route, const cached_message_ptr_t& message);
+
+	// number of routes copies of message are sent to
+	size_t sent_copies_count(const wuuid_t& uuid) const;
+
 	void move_sent_message_to_new(const std::string& route, wuuid_t& uuid);
 	void move_sent_message_to_new_front(const std::string& route, wuuid_t& uuid);
+	// removes message sent to route together with its hedged copies
 	void remove_message_from_cache(const std::string& route, wuuid_t& uuid);
+
+	// removes one copy of hedged message, others stay sent
+	void remove_message_copy(const std::string& route, wuuid_t& uuid);
 	void make_all_messages_new();
-	void get_expired_messages(message_queue_t& expired_messages);
+	void get_expired_messages(message_queue_t& expired_messages,
+							  message_queue_t& hedge_messages);
+
+	// earliest deadline or ack timeout among cached messages, 0 if none
+	double next_expiration_time() const;
 	void make_all_messages_new_for_route(const std::string& route);
 
 	bool reshedule_message(const std::string& route, wuuid_t& uuid);
 
+	// message failed on route and is not sent anywhere anymore, it gets
+	// back to the front of new messages after backoff delay for its policy
+	// and retries count, and is sent to other routes if there are any
+	void schedule_retry(const cached_message_ptr_t& message, const std::string& failed_route);
+
 	void lock();
 
 	void log_stats();
 
 private:
-	static bool is_message_expired(cached_message_ptr_t msg);
+	// node of lock-free stack messages are pushed to by client threads
+	struct incoming_message_t {
+		cached_message_ptr_t	message;
+		incoming_message_t*		next;
+	};
+
+	void push_incoming(incoming_message_t* top, incoming_message_t* bottom);
+	void fetch_incoming();
+
+	enum e_expiration_type {
+		DEADLINE_EXPIRATION = 1,
+		ACK_EXPIRATION,
+		HEDGE_EXPIRATION,
+		RETRY_EXPIRATION
+	};
+
+	// entries of finished messages are not removed from the heap right away,
+	// stale ones are skipped when they reach the top, and the whole heap is
+	// purged of them once they outnumber entries of cached messages
+	struct expiration_t {
+		double	time;
+		int		type;
+
+		// for ack and hedge expirations only, to recognize resent messages
+		double	sent_time;
+
+		boost::weak_ptr<message_iface> message;
+
+		bool operator > (const expiration_t& rhs) const {
+			return time > rhs.time;
+		}
+	};
+
+	// min-heap ordered by std::greater
+	typedef std::vector<expiration_t> expirations_queue_t;
+
+	void push_expiration(const expiration_t& expiration);
+	void pop_expiration();
+	bool is_stale_expiration(const expiration_t& expiration) const;
+	void purge_stale_expirations();
+
+	// how much larger than 3 entries per cached message heap may grow
+	static const size_t expirations_slack = 2;
+	static const size_t min_expirations_purge_size = 1024;
+
+	void schedule_deadline(const cached_message_ptr_t& message);
+	void schedule_ack_timeout(const cached_message_ptr_t& message);
+	double retry_backoff(const cached_message_ptr_t& message);
+	bool remove_sent_message(const cached_message_ptr_t& message);
+	void drop_deadlined_new_messages();
 
 private:
 	enum e_message_cache_type	m_type;
-	route_sent_messages_map_t	m_sent_messages;
+	sent_messages_index_t		m_sent_messages;
 	message_queue_ptr_t			m_new_messages;
+	expirations_queue_t			m_expirations;
 	bool m_locked;
-	boost::mutex m_mutex;
+
+	// messages waiting for retry backoff to pass, expirations
+	// only hold weak references
+	std::set<cached_message_ptr_t>	m_retry_messages;
+	unsigned int					m_random_seed;
+
+	// multiple producers push here, dispatch thread takes
+	// the whole stack at once and appends it to m_new_messages
+	incoming_message_t* volatile m_incoming;
 };
 
 } // namespace dealer
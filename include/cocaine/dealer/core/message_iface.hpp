@@ -22,9 +22,11 @@
 #define _COCAINE_DEALER_MESSAGE_IFACE_HPP_INCLUDED_
 
 #include <string>
+#include <vector>
 
 #include "cocaine/dealer/utils/time_value.hpp"
 #include "cocaine/dealer/utils/uuid.hpp"
+#include "cocaine/dealer/utils/data_container.hpp"
 #include "cocaine/dealer/message_path.hpp"
 #include "cocaine/dealer/message_policy.hpp"
 #include "cocaine/dealer/storage/eblob.hpp"
@@ -39,6 +41,9 @@ public:
 	virtual void* data() = 0;
 	virtual size_t size() const = 0;
 
+	// gives out a reference to in-memory data, false if data can't be shared
+	virtual bool share_data(data_container& data) = 0;
+
 	virtual bool is_data_loaded() = 0;
 	virtual void load_data() = 0;
 	virtual void unload_data() = 0;
@@ -59,10 +64,20 @@ public:
 	virtual const std::string& destination_endpoint() const = 0;
 	virtual void set_destination_endpoint(const std::string& value) = 0;
 
+	virtual const std::string& destination_route() const = 0;
+	virtual void set_destination_route(const std::string& value) = 0;
+
+	// route whose reply is passed on, when message has hedged copies
+	virtual const std::string& reply_route() const = 0;
+	virtual void set_reply_route(const std::string& value) = 0;
+
 	virtual int retries_count() const = 0;
 	virtual void increment_retries_count() = 0;
 	virtual bool can_retry() const = 0;
 
+	virtual const std::vector<std::string>& failed_routes() const = 0;
+	virtual void add_failed_route(const std::string& route) = 0;
+
 	virtual void mark_as_sent(bool value) = 0;
 
 	virtual bool is_expired() = 0;
@@ -0,0 +1,109 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
+#define _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
+
+#include <deque>
+#include <string>
+#include <vector>
+#include <memory>
+
+#include <ev++.h>
+
+#include <boost/utility.hpp>
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition.hpp>
+
+#include "cocaine/dealer/utils/smart_logger.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// single dispatch thread running an event loop shared by many handles
+class reactor_worker_t : private boost::noncopyable {
+public:
+	typedef boost::function<void()> task_t;
+
+	reactor_worker_t(size_t index,
+					 const std::vector<int>& cpus,
+					 const boost::shared_ptr<base_logger_t>& logger);
+	virtual ~reactor_worker_t();
+
+	// must only be used from inside worker thread
+	ev::dynamic_loop& loop();
+
+	// run task inside worker thread
+	void post(const task_t& task);
+
+	// run task inside worker thread and wait for it to finish
+	void execute(const task_t& task);
+
+	bool in_worker_thread() const;
+	size_t index() const;
+
+private:
+	void run();
+	void process_tasks(ev::async& watcher, int type);
+	void run_task(const task_t& task);
+	void terminate();
+
+private:
+	size_t								m_index;
+	std::vector<int>					m_cpus;
+	boost::shared_ptr<base_logger_t>	m_logger;
+
+	std::unique_ptr<ev::dynamic_loop>	m_event_loop;
+	std::unique_ptr<ev::async>			m_tasks_watcher;
+
+	std::deque<task_t>	m_tasks;
+	boost::mutex		m_mutex;
+	boost::thread		m_thread;
+};
+
+// fixed pool of dispatch threads, handles are spread over them
+class reactor_t : private boost::noncopyable {
+public:
+	typedef boost::shared_ptr<reactor_worker_t> worker_ptr_t;
+
+	// workers are pinned one per cpu from the list, if it's not empty
+	reactor_t(size_t workers_count,
+			  const std::vector<int>& cpus,
+			  const boost::shared_ptr<base_logger_t>& logger);
+
+	virtual ~reactor_t();
+
+	worker_ptr_t next_worker();
+	worker_ptr_t worker_for(const std::string& key);
+	size_t workers_count() const;
+
+private:
+	std::vector<worker_ptr_t>	m_workers;
+	size_t						m_next_worker_index;
+	boost::mutex				m_mutex;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_REACTOR_HPP_INCLUDED_
@@ -23,6 +23,7 @@
 
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include <boost/lexical_cast.hpp>
 #include <boost/shared_ptr.hpp>
@@ -62,6 +63,12 @@ struct request_metadata_t {
         s << "policy [timeout]: " << policy.timeout << "\n";
         s << "policy [deadline]: " << policy.deadline << "\n";
         s << "policy [max retries]: " << policy.max_retries << "\n";
+        s << "policy [routing key]: " << policy.routing_key << "\n";
+        s << "policy [hedge delay]: " << policy.hedge_delay << "\n";
+        s << "policy [hedge percentile]: " << policy.hedge_percentile << "\n";
+        s << "policy [retry backoff]: " << policy.retry_backoff << "\n";
+        s << "policy [retry max backoff]: " << policy.retry_max_backoff << "\n";
+        s << "policy [retry jitter]: " << policy.retry_jitter << "\n";
         s << "data_size: " << data_size << "\n";
         s << "enqued timestamp: " << enqued_timestamp.as_string();
         return s.str();
@@ -78,6 +85,8 @@ struct request_metadata_t {
 	wuuid_t				uuid;
 	message_policy_t	policy;
 	std::string			destination_endpoint;
+	std::string			destination_route;
+	std::string			reply_route;
 	uint64_t			data_size;
 
 	time_value	enqued_timestamp;
@@ -89,6 +98,11 @@ struct request_metadata_t {
 	bool	is_sent;
 	int		retries_count;
 
+	// routes message recently failed on, most recent last,
+	// retries are sent elsewhere when possible
+	std::vector<std::string> failed_routes;
+	static const size_t max_failed_routes = 4;
+
 private:
 	boost::flyweight<message_path_t> path_;
 };
@@ -23,23 +23,27 @@
 
 #include <boost/shared_ptr.hpp>
 #include <boost/weak_ptr.hpp>
+#include <boost/enable_shared_from_this.hpp>
 #include <boost/thread.hpp>
 
 #include <list>
+#include <deque>
 
 #include "cocaine/dealer/forwards.hpp"
 #include "cocaine/dealer/utils/data_container.hpp"
 #include "cocaine/dealer/response_chunk.hpp"
+#include "cocaine/dealer/response_handler.hpp"
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/uuid.hpp"
 
 namespace cocaine {
 namespace dealer {
 
-class response_impl_t {
+class response_impl_t : public boost::enable_shared_from_this<response_impl_t> {
 public:
 	response_impl_t(const wuuid_t& uuid,
-					const message_path_t& path);
+					const message_path_t& path,
+					const response_handler_t& handler = response_handler_t());
 
 	~response_impl_t();
 
@@ -53,6 +57,17 @@ private:
 	friend class response_t;
 
 	void add_chunk(const boost::shared_ptr<response_chunk_t>& chunk);
+	bool is_finished();
+	bool claim_route(const std::string& route);
+
+	// handler callbacks of one response never run concurrently
+	void schedule_callback(const response_handler_t::task_t& callback);
+	void run_callbacks();
+
+	void invoke_chunk(const boost::shared_ptr<response_chunk_t>& chunk);
+	void invoke_error(const boost::shared_ptr<response_chunk_t>& chunk);
+	void invoke_complete();
+
 	bool get_chunk(data_container* data) {
 		// process received chunks
 		if (m_chunks.empty()) {
@@ -82,8 +97,16 @@ private:
 	bool m_response_finished;
 	bool m_message_finished;
 
+	// route that replied first, chunks generated locally have no route
+	std::string m_route;
+
 	boost::mutex				m_mutex;
 	boost::condition_variable	m_cond_var;
+
+	const response_handler_t	m_handler;
+
+	std::deque<response_handler_t::task_t>	m_callbacks;
+	bool									m_callbacks_running;
 };
 
 } // namespace dealer
@@ -0,0 +1,130 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_SENT_MESSAGES_INDEX_HPP_INCLUDED_
+#define _COCAINE_DEALER_SENT_MESSAGES_INDEX_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/utility.hpp>
+#include <boost/cstdint.hpp>
+
+#include "cocaine/dealer/core/message_iface.hpp"
+#include "cocaine/dealer/utils/uuid.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// sent messages keyed by raw uuid and route: open addressing hash table
+// with linear probing over a pool of entries, entries of each route are
+// linked into a list so that a route can be dropped without a scan;
+// hedged message has an entry for every route it was sent to
+class sent_messages_index_t : private boost::noncopyable {
+public:
+	typedef boost::shared_ptr<message_iface> message_ptr_t;
+	typedef std::vector<message_ptr_t> messages_list_t;
+
+	sent_messages_index_t();
+	virtual ~sent_messages_index_t();
+
+	void insert(const std::string& route, const message_ptr_t& message);
+
+	// lookups only succeed if message was sent to given route
+	bool find(const wuuid_t& uuid, const std::string& route, message_ptr_t& message) const;
+	bool remove(const wuuid_t& uuid, const std::string& route, message_ptr_t& message);
+
+	// number of routes message with uuid is sent to
+	size_t count(const wuuid_t& uuid) const;
+
+	// removes entries of message from all routes, false if there were none
+	bool remove_message(const message_ptr_t& message);
+
+	void remove_route(const std::string& route, messages_list_t& messages);
+	void remove_all(messages_list_t& messages);
+
+	size_t size() const;
+	size_t route_size(const std::string& route) const;
+	void routes_sizes(std::map<std::string, size_t>& sizes) const;
+
+private:
+	static const boost::uint32_t nil = 0xffffffff;
+	static const size_t initial_capacity = 64;
+
+	struct entry_t {
+		unsigned char	uuid[wuuid_t::UUID_SIZE];
+		boost::uint32_t	route;
+		boost::uint32_t	prev;
+		boost::uint32_t	next;
+		message_ptr_t	message;
+	};
+
+	// table slot, entry index + 1 (0 means empty) and uuid hash
+	struct slot_t {
+		boost::uint32_t	entry;
+		boost::uint32_t	hash;
+	};
+
+	struct route_t {
+		std::string		name;
+		boost::uint32_t	head;
+		size_t			size;
+	};
+
+	static boost::uint32_t hash(const unsigned char* uuid);
+
+	bool find_slot(const unsigned char* uuid,
+				   boost::uint32_t route,
+				   boost::uint32_t hash,
+				   size_t& slot) const;
+
+	// same, but matches route by name, so responses don't need route id
+	bool find_slot(const unsigned char* uuid,
+				   const std::string& route,
+				   boost::uint32_t hash,
+				   size_t& slot) const;
+
+	void insert_slot(boost::uint32_t entry, boost::uint32_t hash);
+	void erase_slot(size_t slot);
+	void grow();
+
+	boost::uint32_t route_id(const std::string& route);
+
+	boost::uint32_t allocate_entry();
+	void release_entry(boost::uint32_t entry);
+
+private:
+	std::vector<slot_t>		m_slots;
+	size_t					m_size;
+
+	std::vector<entry_t>			m_entries;
+	std::vector<boost::uint32_t>	m_free_entries;
+
+	std::vector<route_t>						m_routes;
+	std::vector<boost::uint32_t>				m_free_routes;
+	std::map<std::string, boost::uint32_t>		m_routes_ids;
+};
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_SENT_MESSAGES_INDEX_HPP_INCLUDED_
@@ -31,6 +31,7 @@
 #include <boost/shared_ptr.hpp>
 #include <boost/utility.hpp>
 #include <boost/thread/thread.hpp>
+#include <boost/thread/shared_mutex.hpp>
 #include <boost/function.hpp>
 
 #include "cocaine/dealer/response.hpp"
@@ -42,6 +43,7 @@
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/core/message_iface.hpp"
 #include "cocaine/dealer/core/cocaine_endpoint.hpp"
+#include "cocaine/dealer/core/concurrency_limiter.hpp"
 
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/smart_logger.hpp"
@@ -79,7 +81,11 @@ public:
 	void update_handle(const handle_info_t& handle_info, const std::set<cocaine_endpoint_t>& endpoints);
 	void destroy_handle(const handle_info_t& handle_info);
 
-	boost::shared_ptr<response_t> send_message(cached_message_prt_t message);
+	boost::shared_ptr<response_t> send_message(cached_message_prt_t message,
+											   const response_handler_t& handler = response_handler_t());
+
+	// responses are returned in the same order as messages
+	std::vector<boost::shared_ptr<response_t> > send_messages(const cached_messages_deque_t& messages);
 	bool is_dead();
 
 	service_info_t info() const;
@@ -91,7 +97,16 @@ private:
 
 	void check_for_deadlined_messages();
 
+	// concurrency limit: false if message has to wait for the limit or is
+	// rejected, finished messages let waiting ones go to their handles
+	bool admit_message(const cached_message_prt_t& message);
+	void admit_messages(const cached_messages_deque_t& messages, cached_messages_deque_t& admitted);
+	void reject_message(const cached_message_prt_t& message);
+	void release_message(const boost::shared_ptr<response_chunk_t>& response);
+	void check_for_deadlined_limited_messages();
+
 	bool enque_to_handle(const cached_message_prt_t& message);
+	bool enque_to_handle(const std::string& handle_name, const messages_deque_ptr_t& queue);
 	void enque_to_unhandled(const cached_message_prt_t& message);
 	
 	void append_to_unhandled(const std::string& handle_name,
@@ -119,7 +134,9 @@ private:
 	std::map<std::string, boost::shared_ptr<response_t> > m_responses;
 
 	boost::mutex				m_responces_mutex;
-	boost::mutex				m_handles_mutex;
+	// senders only look handles up, so they share this lock,
+	// handles creation and destruction take it exclusively
+	boost::shared_mutex			m_handles_mutex;
 	boost::mutex				m_unhandled_mutex;
 
 	volatile bool m_is_running;
@@ -131,6 +148,15 @@ private:
 
 	progress_timer m_responces_cleanup_timer;
 
+	// null when service has no concurrency limit
+	std::auto_ptr<concurrency_limiter_t>	m_limiter;
+
+	// send times of messages counted by limiter <uuid, time>,
+	// and messages waiting for the limit
+	std::map<std::string, double>	m_limited_messages;
+	cached_messages_deque_t			m_limiter_queue;
+	boost::mutex					m_limiter_mutex;
+
 	bool m_is_dead;
 };
 
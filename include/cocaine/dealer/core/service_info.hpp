@@ -33,10 +33,25 @@ namespace dealer {
 
 struct service_info_t {
 public:	
-	service_info_t() : discovery_type(AT_UNDEFINED) {};
+	service_info_t() :
+		discovery_type(AT_UNDEFINED),
+		balancing_policy(defaults_t::balancing_policy),
+		endpoint_window(defaults_t::endpoint_window),
+		concurrency_limited(defaults_t::concurrency_limited),
+		concurrency_initial(defaults_t::concurrency_initial),
+		concurrency_min(defaults_t::concurrency_min),
+		concurrency_max(defaults_t::concurrency_max),
+		concurrency_overflow(defaults_t::concurrency_overflow) {};
 	
 	service_info_t(const service_info_t& info) : 
-		discovery_type(AT_UNDEFINED)
+		discovery_type(AT_UNDEFINED),
+		balancing_policy(defaults_t::balancing_policy),
+		endpoint_window(defaults_t::endpoint_window),
+		concurrency_limited(defaults_t::concurrency_limited),
+		concurrency_initial(defaults_t::concurrency_initial),
+		concurrency_min(defaults_t::concurrency_min),
+		concurrency_max(defaults_t::concurrency_max),
+		concurrency_overflow(defaults_t::concurrency_overflow)
 	{
 		*this = info;
 	}
@@ -50,7 +65,14 @@ public:
 					  description(description),
 					  app(app),
 					  hosts_source(hosts_source),
-					  discovery_type(discovery_type) {}
+					  discovery_type(discovery_type),
+					  balancing_policy(defaults_t::balancing_policy),
+					  endpoint_window(defaults_t::endpoint_window),
+					  concurrency_limited(defaults_t::concurrency_limited),
+					  concurrency_initial(defaults_t::concurrency_initial),
+					  concurrency_min(defaults_t::concurrency_min),
+					  concurrency_max(defaults_t::concurrency_max),
+					  concurrency_overflow(defaults_t::concurrency_overflow) {}
 	
 	bool operator == (const service_info_t& rhs) {
 		return (name == rhs.name &&
@@ -85,6 +107,42 @@ public:
 				break;
 		}
 
+		switch (balancing_policy) {
+			case BP_ROUND_ROBIN:
+				out << "balancing: round robin\n";
+				break;
+
+			case BP_LEAST_OUTSTANDING:
+				out << "balancing: least outstanding\n";
+				break;
+
+			case BP_POWER_OF_TWO:
+				out << "balancing: power of two choices\n";
+				break;
+
+			case BP_LATENCY:
+				out << "balancing: latency\n";
+				break;
+		}
+
+		if (endpoint_window < 0) {
+			out << "window: by slaves count\n";
+		}
+		else {
+			out << "window: " << endpoint_window << "\n";
+		}
+
+		if (concurrency_limited) {
+			out << "concurrency limit: " << concurrency_min << " - " << concurrency_max;
+			out << ", initial " << concurrency_initial;
+			out << (concurrency_overflow == LO_REJECT ? ", rejecting" : ", queueing") << " overflow\n";
+		}
+
+		std::map<std::string, double>::const_iterator it = node_weights.begin();
+		for (; it != node_weights.end(); ++it) {
+			out << "node weight: " << it->first << " " << it->second << "\n";
+		}
+
 		return out.str();
 	}
 
@@ -98,6 +156,22 @@ public:
 	enum e_autodiscovery_type discovery_type;
 	short default_discovery_port;
 
+	// endpoint selection
+	enum e_balancing_policy balancing_policy;
+
+	// capacities of nodes by identity, others use announced slaves count
+	std::map<std::string, double> node_weights;
+
+	// unfinished messages per node, see defaults_t::endpoint_window
+	int endpoint_window;
+
+	// adaptive limit of unfinished messages of service
+	bool concurrency_limited;
+	size_t concurrency_initial;
+	size_t concurrency_min;
+	size_t concurrency_max;
+	enum e_limit_overflow concurrency_overflow;
+
 	// default service message policy
 	message_policy_t policy;
 };
@@ -22,12 +22,15 @@
 #define _COCAINE_DEALER_CLIENT_HPP_INCLUDED_
 
 #include <string>
+#include <vector>
 
 #include <boost/utility.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <cocaine/dealer/message.hpp>
 #include <cocaine/dealer/response.hpp>
+#include <cocaine/dealer/response_handler.hpp>
+#include <cocaine/dealer/completion_queue.hpp>
 #include <cocaine/dealer/utils/data_container.hpp>
 #include <cocaine/dealer/message_path.hpp>
 #include <cocaine/dealer/message_policy.hpp>
@@ -90,6 +93,47 @@ public:
 	send_messages(const std::string& data,
 				  const message_path_t& path);
 
+	// send message and receive response chunks asynchronously via handler,
+	// returned response is optional to keep, get() is not used with it
+	response_ptr_t
+	send_message(const message_t& message,
+				 const response_handler_t& handler);
+
+	response_ptr_t
+	send_message(const void* data,
+				 size_t size,
+				 const message_path_t& path,
+				 const message_policy_t& policy,
+				 const response_handler_t& handler);
+
+	response_ptr_t
+	send_message(const std::string& data,
+				 const message_path_t& path,
+				 const message_policy_t& policy,
+				 const response_handler_t& handler);
+
+	// send message and get future for the whole response, it's set from
+	// the dealer thread running response callbacks, continuations run there too
+	response_future_t
+	async_send_message(const message_t& message);
+
+	response_future_t
+	async_send_message(const void* data,
+					   size_t size,
+					   const message_path_t& path,
+					   const message_policy_t& policy);
+
+	// send to all services matching regex, combine with when_all() or when_any()
+	std::vector<response_future_t>
+	async_send_messages(const void* data,
+						size_t size,
+						const message_path_t& path,
+						const message_policy_t& policy);
+
+	// send many messages at once, responses are returned in the same order
+	responses_list_t
+	send_batch(const std::vector<message_t>& messages);
+
 	// send any object supported by msgpack library
 	template <typename T> response_ptr_t
 	send_message(const T& object,
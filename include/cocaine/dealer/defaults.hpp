@@ -38,6 +38,24 @@ enum e_message_cache_type {
 	PERSISTENT
 };
 
+enum e_dispatch_sharding {
+	DS_ROUND_ROBIN = 1,
+	DS_SERVICE,
+	DS_HANDLE
+};
+
+enum e_balancing_policy {
+	BP_ROUND_ROBIN = 1,
+	BP_LEAST_OUTSTANDING,
+	BP_POWER_OF_TWO,
+	BP_LATENCY
+};
+
+enum e_limit_overflow {
+	LO_QUEUE = 1,
+	LO_REJECT
+};
+
 struct defaults_t {
 	// common
 	static const int		protocol_version	= 1;
@@ -45,6 +63,29 @@ struct defaults_t {
 	static const size_t		max_message_size	= 2147483648; // 2 gb (in bytes)
 	static const float		endpoint_timeout;
 
+	// dispatch
+	static const int		io_threads_count		= 1;
+	static const int		dispatch_threads_count	= 2;
+	static const enum e_dispatch_sharding dispatch_sharding = DS_ROUND_ROBIN;
+
+	// balancing
+	static const enum e_balancing_policy balancing_policy = BP_ROUND_ROBIN;
+	static const int		circuit_failures_threshold	= 5;
+	static const float		circuit_ejection_time;
+	static const float		circuit_max_ejection_time;
+
+	// in-flight messages per app node, negative to derive window from
+	// announced slaves count, 0 for unlimited
+	static const int		endpoint_window				= -1;
+	static const int		endpoint_window_per_slave	= 2;
+
+	// adaptive concurrency limit per service
+	static const bool		concurrency_limited		= false;
+	static const size_t		concurrency_initial		= 20;
+	static const size_t		concurrency_min			= 1;
+	static const size_t		concurrency_max			= 1000;
+	static const enum e_limit_overflow concurrency_overflow = LO_QUEUE;
+
 	// logger
 	static const enum e_logger_type	logger_type	= STDOUT_LOGGER;
 	static const unsigned int	logger_flags	= PLOG_NONE;
@@ -56,6 +97,11 @@ struct defaults_t {
 	static const float	policy_ack_timeout;
 	static const float 	policy_chunk_timeout;
 	static const float	policy_message_deadline;
+	static const float	policy_hedge_delay;
+	static const float	policy_hedge_percentile;
+	static const float	policy_retry_backoff;
+	static const float	policy_retry_max_backoff;
+	static const float	policy_retry_jitter;
 
 	// persistance
 	static const enum e_message_cache_type message_cache_type = RAM_ONLY;
@@ -32,6 +32,9 @@ class service_t;
 class response_t;
 class response_impl_t;
 
+class completion_queue_t;
+class completion_queue_impl_t;
+
 } // namespace dealer
 } // namespace cocaine
 
@@ -0,0 +1,356 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_FUTURE_HPP_INCLUDED_
+#define _COCAINE_DEALER_FUTURE_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <cocaine/dealer/utils/error.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+template<typename T> class promise_t;
+
+namespace detail {
+	template<typename R> struct continuation_result;
+	template<typename R, typename T, typename F> struct continuation_runner;
+}
+
+// value that becomes available later. continuations attached with then()
+// run on the thread that sets the value, or right away if it's already set.
+// future of continuation that threw holds error instead of value, get()
+// rethrows it as internal_error, and it's passed on down the chain
+template<typename T>
+class future_t {
+public:
+	typedef boost::function<void(const future_t<T>&)> continuation_t;
+
+	future_t() {}
+
+	bool valid() const {
+		return m_state.get() != NULL;
+	}
+
+	bool ready() const {
+		boost::mutex::scoped_lock lock(m_state->mutex);
+		return m_state->ready;
+	}
+
+	// timeout in seconds, < 0 - wait indefinitely, returns whether value is set
+	bool wait(double timeout = -1.0) const {
+		boost::mutex::scoped_lock lock(m_state->mutex);
+
+		if (timeout < 0.0) {
+			while (!m_state->ready) {
+				m_state->cond_var.wait(lock);
+			}
+
+			return true;
+		}
+
+		boost::system_time t = boost::get_system_time();
+		t += boost::posix_time::microseconds(static_cast<long long>(timeout * 1000000));
+
+		while (!m_state->ready) {
+			if (!m_state->cond_var.timed_wait(lock, t)) {
+				break;
+			}
+		}
+
+		return m_state->ready;
+	}
+
+	// blocks until value is set, throws internal_error if future has error
+	const T& get() const {
+		wait();
+
+		if (m_state->failed) {
+			throw internal_error(m_state->error);
+		}
+
+		return m_state->value;
+	}
+
+	// ready future whose continuation failed
+	bool has_error() const {
+		boost::mutex::scoped_lock lock(m_state->mutex);
+		return m_state->ready && m_state->failed;
+	}
+
+	// returns future of continuation result, so continuations can be
+	// chained, continuation returning nothing gives future_t<bool>
+	// set to true once it ran
+	template<typename F>
+	auto then(F continuation) const
+		-> future_t<typename detail::continuation_result<decltype(continuation(std::declval<const future_t<T>&>()))>::type>
+	{
+		typedef decltype(continuation(std::declval<const future_t<T>&>())) result_t;
+
+		// wrapped, so bind expressions are not composed by boost::bind below
+		typedef boost::function<result_t(const future_t<T>&)> function_t;
+		typedef detail::continuation_runner<result_t, T, function_t> runner_t;
+
+		promise_t<typename detail::continuation_result<result_t>::type> promise;
+		add_continuation(boost::bind(&runner_t::run, function_t(continuation), promise, _1));
+
+		return promise.future();
+	}
+
+private:
+	friend class promise_t<T>;
+
+	void add_continuation(const continuation_t& continuation) const {
+		boost::mutex::scoped_lock lock(m_state->mutex);
+
+		if (!m_state->ready) {
+			m_state->continuations.push_back(continuation);
+			return;
+		}
+
+		lock.unlock();
+		continuation(*this);
+	}
+
+	struct state_t {
+		state_t() : ready(false), failed(false) {}
+
+		boost::mutex				mutex;
+		boost::condition_variable	cond_var;
+		bool						ready;
+		bool						failed;
+		T							value;
+		std::string					error;
+
+		std::vector<continuation_t>	continuations;
+	};
+
+	explicit future_t(const boost::shared_ptr<state_t>& state) :
+		m_state(state) {}
+
+	boost::shared_ptr<state_t> m_state;
+};
+
+template<typename T>
+class promise_t {
+public:
+	promise_t() :
+		m_state(new typename future_t<T>::state_t) {}
+
+	future_t<T> future() const {
+		return future_t<T>(m_state);
+	}
+
+	// only the first value or error is taken, returns false for the rest
+	bool set_value(const T& value) const {
+		{
+			boost::mutex::scoped_lock lock(m_state->mutex);
+
+			if (m_state->ready) {
+				return false;
+			}
+
+			m_state->value = value;
+		}
+
+		complete();
+		return true;
+	}
+
+	bool set_error(const std::string& error) const {
+		{
+			boost::mutex::scoped_lock lock(m_state->mutex);
+
+			if (m_state->ready) {
+				return false;
+			}
+
+			m_state->failed = true;
+			m_state->error = error;
+		}
+
+		complete();
+		return true;
+	}
+
+private:
+	void complete() const {
+		std::vector<typename future_t<T>::continuation_t> continuations;
+
+		{
+			boost::mutex::scoped_lock lock(m_state->mutex);
+			m_state->ready = true;
+			continuations.swap(m_state->continuations);
+		}
+
+		m_state->cond_var.notify_all();
+
+		// continuations from then() don't throw, their errors go to their
+		// futures, but nothing may stop the rest or reach setting thread
+		future_t<T> future(m_state);
+		for (size_t i = 0; i < continuations.size(); ++i) {
+			try {
+				continuations[i](future);
+			}
+			catch (...) {
+			}
+		}
+	}
+
+	boost::shared_ptr<typename future_t<T>::state_t> m_state;
+};
+
+namespace detail {
+
+template<typename R>
+struct continuation_result {
+	typedef R type;
+};
+
+template<>
+struct continuation_result<void> {
+	typedef bool type;
+};
+
+template<typename R, typename T, typename F>
+struct continuation_runner {
+	static void run(const F& continuation, const promise_t<R>& promise, const future_t<T>& future) {
+		try {
+			promise.set_value(continuation(future));
+		}
+		catch (const std::exception& ex) {
+			promise.set_error(ex.what());
+		}
+		catch (...) {
+			promise.set_error("continuation failed with unknown error");
+		}
+	}
+};
+
+template<typename T, typename F>
+struct continuation_runner<void, T, F> {
+	static void run(const F& continuation, const promise_t<bool>& promise, const future_t<T>& future) {
+		try {
+			continuation(future);
+		}
+		catch (const std::exception& ex) {
+			promise.set_error(ex.what());
+			return;
+		}
+		catch (...) {
+			promise.set_error("continuation failed with unknown error");
+			return;
+		}
+
+		promise.set_value(true);
+	}
+};
+
+template<typename T>
+class when_all_t {
+public:
+	when_all_t(size_t count) :
+		m_values(count),
+		m_left(count) {}
+
+	void set(size_t index, const future_t<T>& future) {
+		// first failed future fails them all
+		if (future.has_error()) {
+			try {
+				future.get();
+			}
+			catch (const std::exception& ex) {
+				m_promise.set_error(ex.what());
+			}
+
+			return;
+		}
+
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_values[index] = future.get();
+
+		if (--m_left == 0) {
+			lock.unlock();
+			m_promise.set_value(m_values);
+		}
+	}
+
+	std::vector<T>			m_values;
+	size_t					m_left;
+	boost::mutex			m_mutex;
+	promise_t<std::vector<T> > m_promise;
+};
+
+template<typename T>
+void when_any_ready(const promise_t<size_t>& promise, size_t index, const future_t<T>&) {
+	promise.set_value(index);
+}
+
+} // namespace detail
+
+// ready when all futures are, holds their values in the same order
+template<typename T> future_t<std::vector<T> >
+when_all(const std::vector<future_t<T> >& futures) {
+	boost::shared_ptr<detail::when_all_t<T> > all(new detail::when_all_t<T>(futures.size()));
+	future_t<std::vector<T> > result = all->m_promise.future();
+
+	if (futures.empty()) {
+		all->m_promise.set_value(std::vector<T>());
+		return result;
+	}
+
+	for (size_t i = 0; i < futures.size(); ++i) {
+		futures[i].then(boost::bind(&detail::when_all_t<T>::set, all, i, _1));
+	}
+
+	return result;
+}
+
+// ready when any of futures is, holds index of the first ready one,
+// there has to be at least one future
+template<typename T> future_t<size_t>
+when_any(const std::vector<future_t<T> >& futures) {
+	if (futures.empty()) {
+		throw internal_error("when_any() called with no futures, result would never be ready");
+	}
+
+	promise_t<size_t> promise;
+
+	for (size_t i = 0; i < futures.size(); ++i) {
+		futures[i].then(boost::bind(&detail::when_any_ready<T>, promise, i, _1));
+	}
+
+	return promise.future();
+}
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_FUTURE_HPP_INCLUDED_
@@ -43,6 +43,7 @@
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/uuid.hpp"
 #include "cocaine/dealer/core/handle_info.hpp"
+#include "cocaine/dealer/core/service_info.hpp"
 #include "cocaine/dealer/core/inetv4_host.hpp"
 #include "cocaine/dealer/core/dealer_object.hpp"
 #include "cocaine/dealer/core/io.hpp"
@@ -122,6 +123,18 @@ private:
 	void check_for_timedout_endpoints(ev::timer& timer, int type);
 	bool endpoints_set_equal(const endpoints_set_t& lhs, const endpoints_set_t& rhs);
 	bool all_endpoints_dead(const endpoints_set_t& endpoints);
+
+	// weight of running app endpoints, node capacity from config or announced
+	// slaves count, scaled by announced load down to 1 / load_levels of it
+	double endpoint_weight(const service_info_t& service_info,
+						   const std::string& node_identity,
+						   const cocaine_node_app_info_t& app) const;
+
+	static const int load_levels = 10;
+
+	// max unfinished messages for app endpoints at node, 0 for unlimited
+	size_t endpoint_window(const service_info_t& service_info,
+						   const cocaine_node_app_info_t& app) const;
 	
 	void reset_routing_table(routing_table_t& routing_table);
 	void fetch_and_process_endpoints(ev::timer& watcher, int type);
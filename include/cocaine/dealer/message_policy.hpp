@@ -41,7 +41,12 @@ struct message_policy_t {
 		timeout(defaults_t::policy_chunk_timeout),
 		ack_timeout(defaults_t::policy_ack_timeout),
 		deadline(defaults_t::policy_message_deadline),
-		max_retries(defaults_t::policy_max_retries) {}
+		max_retries(defaults_t::policy_max_retries),
+		hedge_delay(defaults_t::policy_hedge_delay),
+		hedge_percentile(defaults_t::policy_hedge_percentile),
+		retry_backoff(defaults_t::policy_retry_backoff),
+		retry_max_backoff(defaults_t::policy_retry_max_backoff),
+		retry_jitter(defaults_t::policy_retry_jitter) {}
 
 	message_policy_t(bool urgent_,
 					 bool persistent_,
@@ -54,7 +59,12 @@ struct message_policy_t {
 		timeout(timeout_),
 		ack_timeout(ack_timeout_),
 		deadline(deadline_),
-		max_retries(max_retries_) {}
+		max_retries(max_retries_),
+		hedge_delay(defaults_t::policy_hedge_delay),
+		hedge_percentile(defaults_t::policy_hedge_percentile),
+		retry_backoff(defaults_t::policy_retry_backoff),
+		retry_max_backoff(defaults_t::policy_retry_max_backoff),
+		retry_jitter(defaults_t::policy_retry_jitter) {}
 
 	message_policy_t(const message_policy_t& mp) {
 		*this = mp;
@@ -71,6 +81,12 @@ struct message_policy_t {
 		ack_timeout = rhs.ack_timeout;
 		deadline = rhs.deadline;
 		max_retries = rhs.max_retries;
+		routing_key = rhs.routing_key;
+		hedge_delay = rhs.hedge_delay;
+		hedge_percentile = rhs.hedge_percentile;
+		retry_backoff = rhs.retry_backoff;
+		retry_max_backoff = rhs.retry_max_backoff;
+		retry_jitter = rhs.retry_jitter;
 
 		return *this;
 	}
@@ -81,7 +97,13 @@ struct message_policy_t {
 				math::compare_floats(timeout, rhs.timeout) &&
 				math::compare_floats(ack_timeout, rhs.ack_timeout) &&
 				math::compare_floats(deadline, rhs.deadline) &&
-				max_retries == rhs.max_retries);
+				max_retries == rhs.max_retries &&
+				routing_key == rhs.routing_key &&
+				math::compare_floats(hedge_delay, rhs.hedge_delay) &&
+				math::compare_floats(hedge_percentile, rhs.hedge_percentile) &&
+				math::compare_floats(retry_backoff, rhs.retry_backoff) &&
+				math::compare_floats(retry_max_backoff, rhs.retry_max_backoff) &&
+				math::compare_floats(retry_jitter, rhs.retry_jitter));
 	}
 
 	bool operator != (const message_policy_t& rhs) const {
@@ -107,6 +129,21 @@ struct message_policy_t {
 		sstream << "deadline: " << deadline << ", ";
 		sstream << "max_retries: " << max_retries;
 
+		if (max_retries != 0) {
+			sstream << ", retry_backoff: " << retry_backoff;
+			sstream << ", retry_max_backoff: " << retry_max_backoff;
+			sstream << ", retry_jitter: " << retry_jitter;
+		}
+
+		if (!routing_key.empty()) {
+			sstream << ", routing_key: " << routing_key;
+		}
+
+		if (hedge_delay > 0.0 || hedge_percentile > 0.0) {
+			sstream << ", hedge_delay: " << hedge_delay;
+			sstream << ", hedge_percentile: " << hedge_percentile;
+		}
+
 		return sstream.str();
 	}
 
@@ -117,11 +154,35 @@ struct message_policy_t {
 	double      deadline;
 	int         max_retries;
 
+	// messages with the same non-empty key go to the same app node,
+	// as long as it is alive
+	std::string routing_key;
+
+	// for idempotent handles only: a copy of message is sent to another
+	// node if there's no reply after hedge_delay seconds, or after given
+	// percentile of handle's reply latencies when hedge_percentile is set
+	// (hedge_delay is used until enough replies are seen), first reply wins
+	double      hedge_delay;
+	double      hedge_percentile;
+
+	// retries wait retry_backoff seconds, doubled with every next retry
+	// up to retry_max_backoff, minus random part of up to retry_jitter
+	// of the delay, so that retries of many messages don't come at once
+	double      retry_backoff;
+	double      retry_max_backoff;
+	double      retry_jitter;
+
 	MSGPACK_DEFINE(urgent,
 				   timeout,
 				   ack_timeout,
 				   deadline,
-				   max_retries)
+				   max_retries,
+				   routing_key,
+				   hedge_delay,
+				   hedge_percentile,
+				   retry_backoff,
+				   retry_max_backoff,
+				   retry_jitter)
 };
 
 } // namespace dealer
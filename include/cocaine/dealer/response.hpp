@@ -30,16 +30,21 @@
 #include <cocaine/dealer/utils/uuid.hpp>
 #include <cocaine/dealer/response_chunk.hpp>
 #include <cocaine/dealer/message_path.hpp>
+#include <cocaine/dealer/response_handler.hpp>
 
 namespace cocaine {
 namespace dealer {
 
 class response_t {
 public:
-	response_t(const wuuid_t& uuid, const message_path_t& path);
+	response_t(const wuuid_t& uuid,
+			   const message_path_t& path,
+			   const response_handler_t& handler = response_handler_t());
 
 	virtual ~response_t();
 
+	// not for responses created with handler, chunks are passed to it
+	// instead, so get() throws internal_error for them
 	bool get(data_container* data, double timeout = -1.0);
 
 private:
@@ -47,6 +52,14 @@ private:
 
     void add_chunk(const boost::shared_ptr<response_chunk_t>& chunk);
 
+	// response with handler is kept by service until finished
+	bool has_handler() const;
+	bool is_finished();
+
+	// hedged message may be answered from several routes, the first
+	// one to reply wins and chunks from others are to be discarded
+	bool claim_route(const std::string& route);
+
 	boost::shared_ptr<response_impl_t> m_impl;
 };
 
@@ -0,0 +1,98 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#ifndef _COCAINE_DEALER_RESPONSE_HANDLER_HPP_INCLUDED_
+#define _COCAINE_DEALER_RESPONSE_HANDLER_HPP_INCLUDED_
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include <cocaine/dealer/future.hpp>
+#include <cocaine/dealer/utils/data_container.hpp>
+
+namespace cocaine {
+namespace dealer {
+
+// callbacks for asynchronous response processing. callbacks of one response
+// are invoked one at a time and in order: on_chunk for every chunk, then
+// either on_complete or on_error. without executor they're invoked on
+// a single dealer thread shared by callbacks of all responses, so a callback
+// that blocks delays the others. an executor that runs tasks in place
+// invokes them right on the dispatch thread that received the chunk,
+// then they MUST NOT block or send messages, that stalls or deadlocks
+// every handle served by the thread
+class response_handler_t {
+public:
+	typedef boost::function<void(const data_container&)> chunk_callback_t;
+	typedef boost::function<void()> complete_callback_t;
+	typedef boost::function<void(int, const std::string&)> error_callback_t;
+
+	typedef boost::function<void()> task_t;
+	typedef boost::function<void(const task_t&)> executor_t;
+
+	response_handler_t() {}
+
+	response_handler_t(const chunk_callback_t& on_chunk_,
+					   const complete_callback_t& on_complete_,
+					   const error_callback_t& on_error_,
+					   const executor_t& executor_ = executor_t()) :
+		on_chunk(on_chunk_),
+		on_complete(on_complete_),
+		on_error(on_error_),
+		executor(executor_) {}
+
+	bool empty() const {
+		return on_chunk.empty() && on_complete.empty() && on_error.empty();
+	}
+
+	chunk_callback_t	on_chunk;
+	complete_callback_t	on_complete;
+
+	// error code and error message
+	error_callback_t	on_error;
+
+	// optional, runs callbacks elsewhere, i.e. posts them to a thread pool
+	executor_t			executor;
+};
+
+// whole response, as delivered to futures
+class response_result_t {
+public:
+	response_result_t() :
+		error_code(0) {}
+
+	bool ok() const {
+		return error_code == 0;
+	}
+
+	std::vector<data_container> chunks;
+
+	int			error_code;
+	std::string	error_message;
+};
+
+typedef future_t<response_result_t> response_future_t;
+
+} // namespace dealer
+} // namespace cocaine
+
+#endif // _COCAINE_DEALER_RESPONSE_HANDLER_HPP_INCLUDED_
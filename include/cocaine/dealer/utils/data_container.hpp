@@ -45,6 +45,10 @@ public:
 
 	void set_data(const void* data, size_t size);
 
+	// reference data owned by someone else without copying it,
+	// owner is kept alive for as long as any copy of container exists
+	void set_external_data(const void* data, size_t size, const boost::shared_ptr<void>& owner);
+
 	void* data() const;
 	size_t size() const;
 	bool empty() const;
@@ -84,6 +88,9 @@ protected:
 
 	// data reference counter
 	boost::shared_ptr<reference_counter> ref_counter_;
+
+	// holder of external data, data_ is not deleted when set
+	boost::shared_ptr<void> owner_;
 };
 
 } // namespace dealer
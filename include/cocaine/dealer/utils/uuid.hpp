@@ -73,6 +73,11 @@ public:
         return m_str_human_readable_value;
     }
 
+    // raw 16 bytes
+    const unsigned char* data() const {
+        return m_uuid;
+    }
+
     bool is_empty() {
         static uuid_t empty_uuid = {0};
         if (0 == memcmp(m_uuid, empty_uuid, UUID_SIZE)) {
@@ -18,32 +18,79 @@
 	along with this program. If not, see <http://www.gnu.org/licenses/>. 
 */
 
+#include <algorithm>
+#include <cstdlib>
+#include <ctime>
+
 #include <msgpack.hpp>
 
 #include <boost/thread.hpp>
 
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/utils/networking.hpp"
+#include "cocaine/dealer/utils/time_value.hpp"
 #include "cocaine/dealer/core/balancer.hpp"
 
 namespace cocaine {
 namespace dealer {
 
+namespace {
+	uint64_t hash_string(const std::string& str) {
+		// fnv-1a
+		uint64_t hash = 14695981039346656037ULL;
+
+		for (size_t i = 0; i < str.size(); ++i) {
+			hash ^= static_cast<unsigned char>(str[i]);
+			hash *= 1099511628211ULL;
+		}
+
+		return hash;
+	}
+
+	uint64_t mix_hash(uint64_t hash) {
+		// murmur3 finalizer, spreads combined hashes over all bits
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 33;
+
+		return hash;
+	}
+
+	// weight of the newest sample in latency moving averages
+	const double latency_ewma_alpha = 0.3;
+
+	void update_ewma(double& average, double sample) {
+		if (average <= 0.0) {
+			average = sample;
+		}
+		else {
+			average += latency_ewma_alpha * (sample - average);
+		}
+	}
+}
+
 balancer_t::balancer_t(const std::string& identity,
 					   const std::set<cocaine_endpoint_t>& endpoints,
 					   const boost::shared_ptr<context_t>& ctx,
+					   uint64_t io_affinity,
 					   bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
 	m_endpoints(endpoints),
+	m_windows_enabled(false),
+	m_saturated(false),
+	m_ejected_count(0),
+	m_next_probe_time(0.0),
+	m_balancing_policy(BP_ROUND_ROBIN),
 	m_current_endpoint_index(0),
-	m_socket_identity(identity)
+	m_socket_identity(identity),
+	m_io_affinity(io_affinity)
 {
-	create_socket();
+	m_random_seed = static_cast<unsigned int>(time(NULL)) ^ static_cast<unsigned int>(reinterpret_cast<size_t>(this));
 
-	std::set<cocaine_endpoint_t>::iterator it = m_endpoints.begin();
-	for (; it != m_endpoints.end(); ++it) {
-		m_endpoints_vec.push_back(*it);
-	}
+	create_socket();
+	rebuild_endpoints();
 
 	if (m_endpoints.empty()) {
 		return;
@@ -126,17 +173,128 @@ balancer_t::update_endpoints(const std::set<cocaine_endpoint_t>& endpoints,
 	m_endpoints.clear();
 	m_endpoints.insert(endpoints.begin(), endpoints.end());
 
+	rebuild_endpoints();
+
+	connect_socket(new_endpoints);
+}
+
+void
+balancer_t::rebuild_endpoints() {
+	// keep round-robin position of endpoints that stay, so that frequent
+	// weight updates don't favour the heaviest endpoint
+	std::map<std::string, double> current_weights;
+	for (size_t i = 0; i < m_endpoints_vec.size(); ++i) {
+		current_weights[m_endpoints_vec[i].route] = m_current_weights[i];
+	}
+
 	m_endpoints_vec.clear();
-	curr_it = m_endpoints.begin();
-	for (; curr_it != m_endpoints.end(); ++curr_it) {
-		m_endpoints_vec.push_back(*curr_it);
+	m_route_frames.clear();
+	m_route_hashes.clear();
+	m_current_weights.clear();
+
+	std::set<std::string> routes;
+
+	std::set<cocaine_endpoint_t>::iterator it = m_endpoints.begin();
+	for (; it != m_endpoints.end(); ++it) {
+		m_endpoints_vec.push_back(*it);
+		routes.insert(it->route);
+
+		msgpack::sbuffer sbuf;
+		msgpack::pack(sbuf, it->route);
+		m_route_frames.push_back(std::string(sbuf.data(), sbuf.size()));
+		m_route_hashes.push_back(hash_string(it->route));
+
+		std::map<std::string, double>::iterator cit = current_weights.find(it->route);
+		m_current_weights.push_back(cit == current_weights.end() ? 0.0 : cit->second);
 	}
 
-	connect_socket(new_endpoints);
+	// forget latencies and circuits of gone endpoints
+	std::map<std::string, latency_stats_t>::iterator lit = m_latencies.begin();
+	while (lit != m_latencies.end()) {
+		if (routes.find(lit->first) == routes.end()) {
+			m_latencies.erase(lit++);
+		}
+		else {
+			++lit;
+		}
+	}
+
+	std::map<std::string, circuit_t>::iterator cit = m_circuits.begin();
+	while (cit != m_circuits.end()) {
+		if (routes.find(cit->first) == routes.end()) {
+			m_circuits.erase(cit++);
+		}
+		else {
+			++cit;
+		}
+	}
 
+	rebuild_alive_endpoints();
 	m_current_endpoint_index = 0;
 }
 
+void
+balancer_t::rebuild_alive_endpoints() {
+	m_alive_endpoints.clear();
+	m_windows_enabled = false;
+	m_ejected_count = 0;
+	m_next_probe_time = 0.0;
+
+	for (size_t i = 0; i < m_endpoints_vec.size(); ++i) {
+		const cocaine_endpoint_t& endpoint = m_endpoints_vec[i];
+
+		if (endpoint.weight <= 0) {
+			m_current_weights[i] = 0.0;
+			continue;
+		}
+
+		std::map<std::string, circuit_t>::const_iterator it = m_circuits.find(endpoint.route);
+		if (it != m_circuits.end() && it->second.state != CIRCUIT_CLOSED) {
+			++m_ejected_count;
+
+			if (m_next_probe_time == 0.0 || it->second.probe_time < m_next_probe_time)
+			{
+				m_next_probe_time = it->second.probe_time;
+			}
+
+			continue;
+		}
+
+		m_alive_endpoints.push_back(i);
+
+		if (endpoint.window > 0) {
+			m_windows_enabled = true;
+		}
+	}
+}
+
+void
+balancer_t::pack_policy(const policy_t& policy, unsigned char* frame) {
+	// fixarray of 3, bool, float64, float64
+	static const unsigned char policy_frame_template[policy_frame_size] = {
+		0x93, 0xc2, 0xcb, 0, 0, 0, 0, 0, 0, 0, 0, 0xcb, 0, 0, 0, 0, 0, 0, 0, 0
+	};
+
+	memcpy(frame, policy_frame_template, policy_frame_size);
+
+	if (policy.urgent) {
+		frame[1] = 0xc3;
+	}
+
+	double values[2] = { policy.timeout, policy.deadline };
+	unsigned char* value_frame = frame + 3;
+
+	// doubles go big-endian
+	for (size_t i = 0; i < 2; ++i, value_frame += 9) {
+		uint64_t bits;
+		memcpy(&bits, &values[i], sizeof(bits));
+
+		for (size_t j = 0; j < sizeof(bits); ++j) {
+			value_frame[j] = static_cast<unsigned char>(bits >> (56 - 8 * j));
+		}
+	}
+}
+
 void
 balancer_t::create_socket() {
 	try {
@@ -154,6 +312,10 @@ balancer_t::create_socket() {
 		#endif
 
 		m_socket->setsockopt(ZMQ_IDENTITY, m_socket_identity.data(), m_socket_identity.size());
+
+		if (m_io_affinity != 0) {
+			m_socket->setsockopt(ZMQ_AFFINITY, &m_io_affinity, sizeof(m_io_affinity));
+		}
 	}
 	catch (const zmq::error_t& ex) {
 		log(PLOG_ERROR, "could not recreate socket, details: %s", ex.what());
@@ -165,62 +327,504 @@ balancer_t::create_socket() {
 	}
 }
 
+void
+balancer_t::set_balancing_policy(enum e_balancing_policy policy,
+								 const outstanding_counter_t& counter)
+{
+	m_balancing_policy = policy;
+	m_outstanding_counter = counter;
+}
+
 cocaine_endpoint_t&
 balancer_t::get_next_endpoint() {
-	// increment iter
-	if (m_current_endpoint_index < m_endpoints_vec.size() - 1) {
-		++m_current_endpoint_index;
+	assert(!candidate_endpoints().empty());
+
+	if (!m_outstanding_counter) {
+		return round_robin_endpoint();
 	}
-	else {
-		m_current_endpoint_index = 0;
+
+	switch (m_balancing_policy) {
+		case BP_LEAST_OUTSTANDING:
+			return least_outstanding_endpoint();
+
+		case BP_POWER_OF_TWO:
+			return power_of_two_endpoint();
+
+		case BP_LATENCY:
+			return latency_endpoint();
+
+		default:
+			return round_robin_endpoint();
 	}
+}
+
+bool
+balancer_t::next_endpoint_excluding(const std::vector<std::string>& excluded_routes) {
+	for (size_t i = 0; i < candidate_endpoints().size(); ++i) {
+		const cocaine_endpoint_t& candidate = get_next_endpoint();
 
-	// make sure endpoint is avail
-	if (m_endpoints_vec[m_current_endpoint_index].weight > 0) {
-		return m_endpoints_vec[m_current_endpoint_index];
+		if (std::find(excluded_routes.begin(), excluded_routes.end(), candidate.route) == excluded_routes.end()) {
+			return true;
+		}
 	}
 
-	// if not — find the one that is
-	bool found = false;
-	for (size_t i = m_current_endpoint_index; i < m_endpoints_vec.size(); ++i) {
-		if (m_endpoints_vec[i].weight > 0) {
-			m_current_endpoint_index = i;
-			found = true;
+	return false;
+}
+
+bool
+balancer_t::least_recently_failed_endpoint(const std::vector<std::string>& failed_routes) {
+	const std::vector<size_t>& candidates = candidate_endpoints();
+
+	// routes that didn't fail come first, then the ones that failed longest ago
+	size_t best = candidates[0];
+	size_t best_rank = failed_routes.size() + 1;
+
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		const std::string& route = m_endpoints_vec[candidates[i]].route;
+		size_t rank = std::find(failed_routes.begin(), failed_routes.end(), route) - failed_routes.begin();
+
+		if (rank == failed_routes.size()) {
+			m_current_endpoint_index = candidates[i];
+			return false;
+		}
+
+		if (rank < best_rank) {
+			best = candidates[i];
+			best_rank = rank;
+		}
+	}
+
+	m_current_endpoint_index = best;
+	return true;
+}
+
+cocaine_endpoint_t&
+balancer_t::round_robin_endpoint() {
+	// smooth weighted round-robin: every alive endpoint gains its weight,
+	// the one ahead is picked and set back by the total weight, so picks
+	// are proportional to weights and spread evenly, without bursts
+	const std::vector<size_t>& candidates = candidate_endpoints();
+
+	size_t best = candidates[0];
+	double total_weight = 0.0;
+
+	for (size_t i = 0; i < candidates.size(); ++i) {
+		size_t index = candidates[i];
+		m_current_weights[index] += m_endpoints_vec[index].weight;
+		total_weight += m_endpoints_vec[index].weight;
+
+		if (m_current_weights[index] > m_current_weights[best]) {
+			best = index;
+		}
+	}
+
+	m_current_weights[best] -= total_weight;
+	m_current_endpoint_index = best;
+
+	return m_endpoints_vec[m_current_endpoint_index];
+}
+
+cocaine_endpoint_t&
+balancer_t::keyed_endpoint(const std::string& routing_key) {
+	// the endpoint with the highest score wins, so when one goes away or
+	// comes back only keys that hash to it are moved
+	uint64_t key_hash = hash_string(routing_key);
+
+	size_t best = m_alive_endpoints[0];
+	uint64_t best_score = mix_hash(key_hash ^ m_route_hashes[best]);
+
+	for (size_t i = 1; i < m_alive_endpoints.size(); ++i) {
+		size_t index = m_alive_endpoints[i];
+		uint64_t score = mix_hash(key_hash ^ m_route_hashes[index]);
+
+		if (score > best_score) {
+			best = index;
+			best_score = score;
+		}
+	}
+
+	m_current_endpoint_index = best;
+	return m_endpoints_vec[m_current_endpoint_index];
+}
+
+bool
+balancer_t::less_loaded(size_t a, size_t b) const {
+	// (outstanding + 1) / weight, compared without division
+	size_t load_a = m_outstanding_counter(m_endpoints_vec[a].route) + 1;
+	size_t load_b = m_outstanding_counter(m_endpoints_vec[b].route) + 1;
+
+	return load_a * m_endpoints_vec[b].weight < load_b * m_endpoints_vec[a].weight;
+}
+
+cocaine_endpoint_t&
+balancer_t::least_outstanding_endpoint() {
+	const std::vector<size_t>& candidates = candidate_endpoints();
+	size_t alive_count = candidates.size();
+
+	// start scan after previous choice, so that ties are spread round-robin
+	size_t start = 0;
+	for (size_t i = 0; i < alive_count; ++i) {
+		if (candidates[i] > m_current_endpoint_index) {
+			start = i;
 			break;
 		}
 	}
 
-	if (!found) {
-		for (size_t i = 0; i < m_current_endpoint_index; ++i) {
-			if (m_endpoints_vec[i].weight > 0) {
-				m_current_endpoint_index = i;
-				found = true;
+	size_t best = candidates[start];
+	for (size_t i = 1; i < alive_count; ++i) {
+		size_t candidate = candidates[(start + i) % alive_count];
+
+		if (less_loaded(candidate, best)) {
+			best = candidate;
+		}
+	}
+
+	m_current_endpoint_index = best;
+	return m_endpoints_vec[best];
+}
+
+void
+balancer_t::random_endpoints_pair(size_t& first, size_t& second) {
+	const std::vector<size_t>& candidates = candidate_endpoints();
+	size_t alive_count = candidates.size();
+
+	if (alive_count == 1) {
+		first = second = candidates[0];
+		return;
+	}
+
+	first = rand_r(&m_random_seed) % alive_count;
+	second = rand_r(&m_random_seed) % (alive_count - 1);
+
+	if (second >= first) {
+		++second;
+	}
+
+	first = candidates[first];
+	second = candidates[second];
+}
+
+cocaine_endpoint_t&
+balancer_t::power_of_two_endpoint() {
+	size_t first;
+	size_t second;
+	random_endpoints_pair(first, second);
+
+	m_current_endpoint_index = less_loaded(second, first) ? second : first;
+	return m_endpoints_vec[m_current_endpoint_index];
+}
+
+double
+balancer_t::endpoint_latency(size_t index) const {
+	std::map<std::string, latency_stats_t>::const_iterator it;
+	it = m_latencies.find(m_endpoints_vec[index].route);
+
+	if (it == m_latencies.end()) {
+		return 0.0;
+	}
+
+	return (it->second.choke > 0.0) ? it->second.choke : it->second.ack;
+}
+
+double
+balancer_t::latency_cost(size_t index, double latency) const {
+	const cocaine_endpoint_t& endpoint = m_endpoints_vec[index];
+	size_t outstanding = m_outstanding_counter(endpoint.route);
+
+	return latency * (outstanding + 1) / endpoint.weight;
+}
+
+cocaine_endpoint_t&
+balancer_t::latency_endpoint() {
+	size_t first;
+	size_t second;
+	random_endpoints_pair(first, second);
+
+	double first_latency = endpoint_latency(first);
+	double second_latency = endpoint_latency(second);
+
+	// endpoints without samples yet are assumed to be as fast as the other one,
+	// so that they get a share of traffic and get measured
+	if (first_latency <= 0.0) {
+		first_latency = (second_latency > 0.0) ? second_latency : 1.0;
+	}
+
+	if (second_latency <= 0.0) {
+		second_latency = first_latency;
+	}
+
+	double first_cost = latency_cost(first, first_latency);
+	double second_cost = latency_cost(second, second_latency);
+
+	m_current_endpoint_index = (second_cost < first_cost) ? second : first;
+	return m_endpoints_vec[m_current_endpoint_index];
+}
+
+void
+balancer_t::update_open_endpoints() {
+	if (!m_windows_enabled || !m_outstanding_counter) {
+		return;
+	}
+
+	m_open_endpoints.clear();
+
+	for (size_t i = 0; i < m_alive_endpoints.size(); ++i) {
+		const cocaine_endpoint_t& endpoint = m_endpoints_vec[m_alive_endpoints[i]];
+
+		if (endpoint.window == 0 || m_outstanding_counter(endpoint.route) < endpoint.window) {
+			m_open_endpoints.push_back(m_alive_endpoints[i]);
+		}
+	}
+}
+
+const std::vector<size_t>&
+balancer_t::candidate_endpoints() const {
+	if (!m_windows_enabled || !m_outstanding_counter) {
+		return m_alive_endpoints;
+	}
+
+	return m_open_endpoints;
+}
+
+bool
+balancer_t::is_saturated() const {
+	return m_saturated;
+}
+
+bool
+balancer_t::has_alive_endpoints() const {
+	return !m_alive_endpoints.empty();
+}
+
+bool
+balancer_t::probe_endpoint() {
+	if (m_ejected_count == 0 || m_next_probe_time == 0.0) {
+		return false;
+	}
+
+	double now = time_value::get_current_time().as_double();
+
+	if (now < m_next_probe_time) {
+		return false;
+	}
+
+	for (size_t i = 0; i < m_endpoints_vec.size(); ++i) {
+		const cocaine_endpoint_t& endpoint = m_endpoints_vec[i];
+
+		std::map<std::string, circuit_t>::iterator it = m_circuits.find(endpoint.route);
+		if (endpoint.weight <= 0 || it == m_circuits.end()) {
+			continue;
+		}
+
+		circuit_t& circuit = it->second;
+
+		// probe without outcome for too long is considered lost
+		if (circuit.state != CIRCUIT_CLOSED && circuit.probe_time <= now) {
+			// single message goes there, others wait for its outcome
+			circuit.state = CIRCUIT_HALF_OPEN;
+			circuit.probe_time = now + defaults_t::circuit_max_ejection_time;
+			rebuild_alive_endpoints();
+
+			m_current_endpoint_index = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+void
+balancer_t::report_success(const std::string& route, const wuuid_t& uuid) {
+	std::map<std::string, circuit_t>::iterator it = m_circuits.find(route);
+
+	if (it == m_circuits.end()) {
+		return;
+	}
+
+	circuit_t& circuit = it->second;
+
+	switch (circuit.state) {
+		case CIRCUIT_CLOSED:
+			m_circuits.erase(it);
+			break;
+
+		case CIRCUIT_HALF_OPEN:
+			// late reply to message sent before ejection, probe decides
+			if (!(circuit.probe_uuid == uuid)) {
 				break;
 			}
+
+			m_circuits.erase(it);
+			rebuild_alive_endpoints();
+
+			if (log_flag_enabled(PLOG_INFO)) {
+				log(PLOG_INFO, "endpoint with route %s is back in rotation", route.c_str());
+			}
+			break;
+
+		default:
+			// late reply to message sent before ejection, probe decides
+			break;
+	}
+}
+
+void
+balancer_t::report_failure(const std::string& route, const wuuid_t& uuid) {
+	bool known_route = false;
+
+	for (size_t i = 0; i < m_endpoints_vec.size(); ++i) {
+		if (m_endpoints_vec[i].route == route) {
+			known_route = true;
+			break;
 		}
 	}
 
-	assert(found);
-	
-	return m_endpoints_vec[m_current_endpoint_index];
+	if (!known_route) {
+		return;
+	}
+
+	circuit_t& circuit = m_circuits[route];
+
+	switch (circuit.state) {
+		case CIRCUIT_CLOSED:
+			++circuit.failures;
+
+			if (circuit.failures < defaults_t::circuit_failures_threshold) {
+				return;
+			}
+
+			// never eject more than half of alive endpoints, failures
+			// of most of them are rather caused by the app or by us
+			if ((m_ejected_count + 1) * 2 > m_alive_endpoints.size() + m_ejected_count) {
+				return;
+			}
+			break;
+
+		case CIRCUIT_HALF_OPEN:
+			if (!(circuit.probe_uuid == uuid)) {
+				return;
+			}
+			break;
+
+		default:
+			return;
+	}
+
+	// ejection time doubles with each failed probe
+	double ejection_time = defaults_t::circuit_ejection_time * (1 << std::min(circuit.ejections, 6));
+	ejection_time = std::min(ejection_time, static_cast<double>(defaults_t::circuit_max_ejection_time));
+
+	circuit.state = CIRCUIT_OPEN;
+	circuit.failures = 0;
+	++circuit.ejections;
+	circuit.probe_time = time_value::get_current_time().as_double() + ejection_time;
+
+	rebuild_alive_endpoints();
+
+	if (log_flag_enabled(PLOG_WARNING)) {
+		log(PLOG_WARNING, "endpoint with route %s is ejected from rotation for %f seconds",
+			route.c_str(), ejection_time);
+	}
+}
+
+void
+balancer_t::update_ack_latency(const std::string& route, double latency) {
+	if (m_balancing_policy != BP_LATENCY || latency <= 0.0) {
+		return;
+	}
+
+	update_ewma(m_latencies[route].ack, latency);
+}
+
+void
+balancer_t::update_choke_latency(const std::string& route, double latency) {
+	if (m_balancing_policy != BP_LATENCY || latency <= 0.0) {
+		return;
+	}
+
+	update_ewma(m_latencies[route].choke, latency);
 }
 
 bool
 balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t& endpoint) {
 	assert(m_socket);
 
-	try {
-		// send ident
-		endpoint = get_next_endpoint();
-		message->set_destination_endpoint(endpoint.endpoint);
+	// no alive endpoints, message stays queued
+	if (m_alive_endpoints.empty()) {
+		return false;
+	}
 
-		std::string new_route = endpoint.route;
+	const std::string& routing_key = message->policy().routing_key;
+	m_saturated = false;
 
-		msgpack::sbuffer sbuf;
-        msgpack::pack(sbuf, new_route);
+	// keyed messages are not used as probes, they would leave their node,
+	// and they ignore windows, as waiting for it would block the queue,
+	// retried messages are not used as probes either
+	if (routing_key.empty() && message->failed_routes().empty() && probe_endpoint()) {
+		endpoint = m_endpoints_vec[m_current_endpoint_index];
+		m_circuits[endpoint.route].probe_uuid = message->uuid();
+	}
+	else if (routing_key.empty()) {
+		update_open_endpoints();
+
+		// all windows are full, message waits in queue
+		if (candidate_endpoints().empty()) {
+			m_saturated = true;
+			return false;
+		}
+
+		// retried message goes to a node it didn't fail on, if there is one
+		if (!next_endpoint_excluding(message->failed_routes()) &&
+			least_recently_failed_endpoint(message->failed_routes()))
+		{
+			if (log_flag_enabled(PLOG_WARNING)) {
+				log(PLOG_WARNING, "message %s failed on all endpoints recently, retrying it on route %s",
+					message->uuid().as_human_readable_string().c_str(),
+					m_endpoints_vec[m_current_endpoint_index].route.c_str());
+			}
+		}
+
+		endpoint = m_endpoints_vec[m_current_endpoint_index];
+	}
+	else {
+		endpoint = keyed_endpoint(routing_key);
+	}
+
+	message->set_destination_endpoint(endpoint.endpoint);
+
+	return send_to_current_endpoint(message);
+}
+
+bool
+balancer_t::send_hedge(boost::shared_ptr<message_iface>& message,
+					   const std::string& excluded_route,
+					   cocaine_endpoint_t& endpoint)
+{
+	assert(m_socket);
+
+	update_open_endpoints();
+
+	if (candidate_endpoints().size() < 2) {
+		return false;
+	}
+
+	// regular balancing, skipping the node original message went to
+	if (!next_endpoint_excluding(std::vector<std::string>(1, excluded_route))) {
+		return false;
+	}
 
-		zmq::message_t ident_chunk(sbuf.size());
-		memcpy((void *)ident_chunk.data(), sbuf.data(), sbuf.size());
+	endpoint = m_endpoints_vec[m_current_endpoint_index];
+	return send_to_current_endpoint(message);
+}
+
+bool
+balancer_t::send_to_current_endpoint(boost::shared_ptr<message_iface>& message) {
+	try {
+		// send ident
+		const std::string& route_frame = m_route_frames[m_current_endpoint_index];
+
+		zmq::message_t ident_chunk(route_frame.size());
+		memcpy((void *)ident_chunk.data(), route_frame.data(), route_frame.size());
 
 		if (true != m_socket->send(ident_chunk, ZMQ_SNDMORE)) {
 			return false;
@@ -233,10 +837,8 @@ balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t&
 		}
 
 		// send message uuid
-		const std::string& uuid = message->uuid().as_string();
-
-		zmq::message_t uuid_chunk(uuid.size());
-		memcpy((void *)uuid_chunk.data(), uuid.data(), uuid.size());
+		zmq::message_t uuid_chunk(wuuid_t::UUID_SIZE);
+		memcpy((void *)uuid_chunk.data(), message->uuid().data(), wuuid_t::UUID_SIZE);
 
 		if (true != m_socket->send(uuid_chunk, ZMQ_SNDMORE)) {
 			return false;
@@ -252,10 +854,8 @@ balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t&
 			server_policy.deadline = server_deadline.as_double();
 		}
 
-		sbuf.clear();
-		msgpack::pack(sbuf, server_policy);
-		zmq::message_t policy_chunk(sbuf.size());
-		memcpy((void *)policy_chunk.data(), sbuf.data(), sbuf.size());
+		zmq::message_t policy_chunk(policy_frame_size);
+		pack_policy(server_policy, static_cast<unsigned char*>(policy_chunk.data()));
 
 		if (true != m_socket->send(policy_chunk, ZMQ_SNDMORE)) {
 			return false;
@@ -263,16 +863,33 @@ balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t&
 
 		// send data
 		size_t data_size = message->size();
-		zmq::message_t data_chunk(data_size);
+		data_container shared_data;
+
+		if (data_size > 0 && message->share_data(shared_data)) {
+			// zmq holds a reference to message data until it's sent
+			data_container* data_ref = new data_container(shared_data);
 
-		if (data_size > 0) {
-			message->load_data();
-			memcpy((void *)data_chunk.data(), message->data(), data_size);
-			message->unload_data();
+			zmq::message_t data_chunk(data_ref->data(),
+									  data_ref->size(),
+									  &balancer_t::release_data,
+									  data_ref);
+
+			if (true != m_socket->send(data_chunk)) {
+				return false;
+			}
 		}
+		else {
+			zmq::message_t data_chunk(data_size);
 
-		if (true != m_socket->send(data_chunk)) {
-			return false;
+			if (data_size > 0) {
+				message->load_data();
+				memcpy((void *)data_chunk.data(), message->data(), data_size);
+				message->unload_data();
+			}
+
+			if (true != m_socket->send(data_chunk)) {
+				return false;
+			}
 		}
 	}
 	catch (const std::exception& ex) {
@@ -285,6 +902,12 @@ balancer_t::send(boost::shared_ptr<message_iface>& message, cocaine_endpoint_t&
 	return true;
 }
 
+void
+balancer_t::release_data(void* data, void* hint) {
+	// called by zmq io thread once data was sent
+	delete static_cast<data_container*>(hint);
+}
+
 bool
 balancer_t::check_for_responses(int poll_timeout) const {
 	assert(m_socket);
@@ -314,6 +937,17 @@ balancer_t::check_for_responses(int poll_timeout) const {
 	return false;
 }
 
+int
+balancer_t::fd() const {
+	assert(m_socket);
+
+	int fd = -1;
+	size_t fd_size = sizeof(fd);
+	m_socket->getsockopt(ZMQ_FD, &fd, &fd_size);
+
+	return fd;
+}
+
 bool
 balancer_t::is_valid_rpc_code(int rpc_code) {
 	switch (rpc_code) {
@@ -338,13 +972,6 @@ namespace {
 		MSGPACK_DEFINE(code, data)
 	};
 
-	struct unpacked_chunk {
-		std::string uuid;
-		std::string data;
-
-		MSGPACK_DEFINE(uuid, data)
-	};
-
 	struct unpacked_error {
 		std::string uuid;
 		int			code;
@@ -371,6 +998,9 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	zmq::message_t		chunk;
 	msgpack::unpacked 	unpacked;
 
+	// response frame is shared with chunk data, so that it's not copied
+	boost::shared_ptr<zmq::message_t> response_frame(new zmq::message_t);
+
 	std::string			identity;
 	std::string			data;
 	int					rpc_code;
@@ -393,7 +1023,7 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	}
 
 	// receive response
-	if (!nutils::recv_zmq_message(*m_socket, chunk, unpacked)) {
+	if (!nutils::recv_zmq_message(*m_socket, *response_frame, unpacked)) {
 		return false;
 	}
 
@@ -415,11 +1045,22 @@ balancer_t::receive(boost::shared_ptr<response_chunk_t>& response) {
 	// receive all data
 	switch (rpc_code) {
 		case SERVER_RPC_MESSAGE_CHUNK: {
-			unpacked_chunk chunk_resp;
-			unpacked.get().via.array.ptr[1].convert(&chunk_resp);
+			// [uuid, data], unpacked raw data points right into the frame
+			const msgpack::object& chunk_resp = unpacked.get().via.array.ptr[1];
+
+			if (chunk_resp.type != msgpack::type::ARRAY ||
+				chunk_resp.via.array.size != 2 ||
+				chunk_resp.via.array.ptr[1].type != msgpack::type::RAW)
+			{
+				throw msgpack::type_error();
+			}
+
+			std::string uuid;
+			chunk_resp.via.array.ptr[0].convert(&uuid);
+			response->uuid = uuid;
 
-			response->uuid = chunk_resp.uuid;
-			response->data = data_container(chunk_resp.data.data(), chunk_resp.data.size());
+			const msgpack::object_raw& data = chunk_resp.via.array.ptr[1].via.raw;
+			response->data.set_external_data(data.ptr, data.size, response_frame);
 		}
 		break;
 
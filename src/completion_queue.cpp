@@ -0,0 +1,143 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <deque>
+
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "cocaine/dealer/completion_queue.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+// shared with handlers, so responses outliving the queue stay safe
+class completion_queue_impl_t {
+public:
+	void push_chunk(void* tag, const data_container& data) {
+		completion_event_t event;
+		event.tag = tag;
+		event.type = COMPLETION_CHUNK;
+		event.data = data;
+		push(event);
+	}
+
+	void push_done(void* tag) {
+		completion_event_t event;
+		event.tag = tag;
+		event.type = COMPLETION_DONE;
+		push(event);
+	}
+
+	void push_error(void* tag, int error_code, const std::string& error_message) {
+		completion_event_t event;
+		event.tag = tag;
+		event.type = COMPLETION_ERROR;
+		event.error_code = error_code;
+		event.error_message = error_message;
+		push(event);
+	}
+
+	void push(const completion_event_t& event) {
+		boost::mutex::scoped_lock lock(m_mutex);
+
+		bool was_empty = m_events.empty();
+		m_events.push_back(event);
+
+		lock.unlock();
+
+		// waiters only sleep on empty queue
+		if (was_empty) {
+			m_cond_var.notify_one();
+		}
+	}
+
+	std::deque<completion_event_t>	m_events;
+	mutable boost::mutex			m_mutex;
+	boost::condition_variable		m_cond_var;
+};
+
+completion_queue_t::completion_queue_t() :
+	m_impl(new completion_queue_impl_t)
+{
+}
+
+completion_queue_t::~completion_queue_t() {
+}
+
+response_handler_t
+completion_queue_t::handler(void* tag) {
+	return response_handler_t(boost::bind(&completion_queue_impl_t::push_chunk, m_impl, tag, _1),
+							  boost::bind(&completion_queue_impl_t::push_done, m_impl, tag),
+							  boost::bind(&completion_queue_impl_t::push_error, m_impl, tag, _1, _2));
+}
+
+size_t
+completion_queue_t::wait(std::vector<completion_event_t>& events,
+						 double timeout,
+						 size_t max_events)
+{
+	boost::mutex::scoped_lock lock(m_impl->m_mutex);
+
+	if (timeout < 0.0) {
+		while (m_impl->m_events.empty()) {
+			m_impl->m_cond_var.wait(lock);
+		}
+	}
+	else if (timeout > 0.0) {
+		boost::system_time t = boost::get_system_time();
+		t += boost::posix_time::microseconds(static_cast<long long>(timeout * 1000000));
+
+		while (m_impl->m_events.empty()) {
+			if (!m_impl->m_cond_var.timed_wait(lock, t)) {
+				break;
+			}
+		}
+	}
+
+	size_t count = m_impl->m_events.size();
+	if (max_events > 0 && count > max_events) {
+		count = max_events;
+	}
+
+	events.insert(events.end(), m_impl->m_events.begin(), m_impl->m_events.begin() + count);
+	m_impl->m_events.erase(m_impl->m_events.begin(), m_impl->m_events.begin() + count);
+
+	// let other waiters pick the rest
+	bool has_more = !m_impl->m_events.empty();
+	lock.unlock();
+
+	if (has_more) {
+		m_impl->m_cond_var.notify_one();
+	}
+
+	return count;
+}
+
+size_t
+completion_queue_t::size() const {
+	boost::mutex::scoped_lock lock(m_impl->m_mutex);
+	return m_impl->m_events.size();
+}
+
+} // namespace dealer
+} // namespace cocaine
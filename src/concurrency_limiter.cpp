@@ -0,0 +1,136 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "cocaine/dealer/core/concurrency_limiter.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+namespace {
+	// share of new limit estimate applied at once
+	const double limit_smoothing = 0.2;
+
+	// no-load latency is re-measured every that many windows, with
+	// the limit halved for a while, to follow app and network changes
+	const size_t min_latency_windows = 100;
+
+	// limit cut on dropped message
+	const double drop_backoff = 0.9;
+}
+
+concurrency_limiter_t::concurrency_limiter_t(size_t initial_limit, size_t min_limit, size_t max_limit) :
+	m_limit(initial_limit),
+	m_min_limit(std::max<size_t>(min_limit, 1)),
+	m_max_limit(std::max(max_limit, m_min_limit)),
+	m_inflight(0),
+	m_min_latency(0.0),
+	m_min_latency_age(0)
+{
+	m_limit = std::min<double>(std::max<double>(m_limit, m_min_limit), m_max_limit);
+	reset_window();
+}
+
+concurrency_limiter_t::~concurrency_limiter_t() {
+}
+
+void
+concurrency_limiter_t::reset_window() {
+	m_window_latency_sum = 0.0;
+	m_window_samples = 0;
+	m_window_max_inflight = m_inflight;
+}
+
+bool
+concurrency_limiter_t::try_acquire() {
+	if (m_inflight >= limit()) {
+		return false;
+	}
+
+	++m_inflight;
+	m_window_max_inflight = std::max(m_window_max_inflight, m_inflight);
+
+	return true;
+}
+
+void
+concurrency_limiter_t::release(double latency, bool dropped) {
+	if (m_inflight > 0) {
+		--m_inflight;
+	}
+
+	if (dropped) {
+		m_limit = std::max<double>(m_limit * drop_backoff, m_min_limit);
+		reset_window();
+		return;
+	}
+
+	if (latency <= 0.0) {
+		return;
+	}
+
+	m_window_latency_sum += latency;
+
+	if (++m_window_samples < window_size) {
+		return;
+	}
+
+	double short_latency = m_window_latency_sum / m_window_samples;
+	bool limit_reached = (m_window_max_inflight * 2 >= limit());
+	reset_window();
+
+	if (m_min_latency <= 0.0 || short_latency < m_min_latency || m_min_latency_age > min_latency_windows) {
+		m_min_latency = short_latency;
+		m_min_latency_age = 0;
+	}
+	else if (++m_min_latency_age == min_latency_windows) {
+		// window after this one measures latency with less queueing
+		m_limit = std::max<double>(m_limit / 2.0, m_min_limit);
+		++m_min_latency_age;
+		return;
+	}
+
+	// few messages in flight tell nothing about the limit
+	if (!limit_reached) {
+		return;
+	}
+
+	// latency above no-load one means messages queue up somewhere
+	double gradient = std::max(0.5, std::min(1.0, m_min_latency / short_latency));
+	double estimate = m_limit * gradient + std::sqrt(m_limit);
+
+	m_limit = m_limit * (1.0 - limit_smoothing) + estimate * limit_smoothing;
+	m_limit = std::min<double>(std::max<double>(m_limit, m_min_limit), m_max_limit);
+}
+
+size_t
+concurrency_limiter_t::limit() const {
+	return static_cast<size_t>(m_limit);
+}
+
+size_t
+concurrency_limiter_t::inflight() const {
+	return m_inflight;
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -37,6 +37,9 @@ configuration_t::configuration_t() :
 	m_message_cache_type(defaults_t::message_cache_type),
 	m_logger_type(defaults_t::logger_type),
 	m_logger_flags(defaults_t::logger_flags),
+	m_io_threads_count(defaults_t::io_threads_count),
+	m_dispatch_threads_count(defaults_t::dispatch_threads_count),
+	m_dispatch_sharding(defaults_t::dispatch_sharding),
 	m_eblob_path(defaults_t::eblob_path),
 	m_eblob_blob_size(defaults_t::eblob_blob_size),
 	m_eblob_sync_interval(defaults_t::eblob_sync_interval),
@@ -55,6 +58,9 @@ configuration_t::configuration_t(const std::string& path) :
 	m_message_cache_type(defaults_t::message_cache_type),
 	m_logger_type(defaults_t::logger_type),
 	m_logger_flags(defaults_t::logger_flags),
+	m_io_threads_count(defaults_t::io_threads_count),
+	m_dispatch_threads_count(defaults_t::dispatch_threads_count),
+	m_dispatch_sharding(defaults_t::dispatch_sharding),
 	m_eblob_path(defaults_t::eblob_path),
 	m_eblob_blob_size(defaults_t::eblob_blob_size),
 	m_eblob_sync_interval(defaults_t::eblob_sync_interval),
@@ -161,6 +167,66 @@ configuration_t::parse_logger_settings(const Json::Value& config_value) {
 	}
 }
 
+void
+configuration_t::parse_cpus_list(const Json::Value& cpus_value, std::vector<int>& cpus) {
+	cpus.clear();
+
+	if (cpus_value.isNull()) {
+		return;
+	}
+
+	if (!cpus_value.isArray()) {
+		std::string error_str = "cpus list in \"dispatch\" section is malformed, ";
+		error_str += "it must be an array of cpu numbers, for example [0, 1, 2].";
+		throw internal_error(error_str);
+	}
+
+	for (Json::Value::UInt i = 0; i < cpus_value.size(); ++i) {
+		int cpu = cpus_value[i].asInt();
+
+		if (cpu < 0) {
+			throw internal_error("cpu number in \"dispatch\" section can not be negative.");
+		}
+
+		cpus.push_back(cpu);
+	}
+}
+
+void
+configuration_t::parse_dispatch_settings(const Json::Value& config_value) {
+	const Json::Value dispatch_value = config_value["dispatch"];
+
+	m_io_threads_count = dispatch_value.get("io_threads", defaults_t::io_threads_count).asInt();
+	if (m_io_threads_count < 1) {
+		m_io_threads_count = 1;
+	}
+
+	m_dispatch_threads_count = dispatch_value.get("workers", defaults_t::dispatch_threads_count).asInt();
+	if (m_dispatch_threads_count < 1) {
+		m_dispatch_threads_count = 1;
+	}
+
+	parse_cpus_list(dispatch_value["io_threads_cpus"], m_io_threads_cpus);
+	parse_cpus_list(dispatch_value["workers_cpus"], m_dispatch_threads_cpus);
+
+	std::string sharding = dispatch_value.get("sharding", "ROUND_ROBIN").asString();
+
+	if (sharding == "ROUND_ROBIN") {
+		m_dispatch_sharding = DS_ROUND_ROBIN;
+	}
+	else if (sharding == "SERVICE") {
+		m_dispatch_sharding = DS_SERVICE;
+	}
+	else if (sharding == "HANDLE") {
+		m_dispatch_sharding = DS_HANDLE;
+	}
+	else {
+		std::string error_str = "unknown dispatch sharding: " + sharding;
+		error_str += ", sharding property can only take ROUND_ROBIN, SERVICE or HANDLE as value.";
+		throw internal_error(error_str);
+	}
+}
+
 void
 configuration_t::parse_persistant_storage_settings(const Json::Value& config_value) {
 	const Json::Value persistent_storage_value = config_value["persistent_storage"];
@@ -268,6 +334,86 @@ configuration_t::parse_services_settings(const Json::Value& config_value) {
 			throw internal_error(error_str);
 		}
 
+		// endpoint selection
+		std::string balancing_str = service_data.get("balancing", "ROUND_ROBIN").asString();
+
+		if (balancing_str == "ROUND_ROBIN") {
+			si.balancing_policy = BP_ROUND_ROBIN;
+		}
+		else if (balancing_str == "LEAST_OUTSTANDING") {
+			si.balancing_policy = BP_LEAST_OUTSTANDING;
+		}
+		else if (balancing_str == "POWER_OF_TWO") {
+			si.balancing_policy = BP_POWER_OF_TWO;
+		}
+		else if (balancing_str == "LATENCY") {
+			si.balancing_policy = BP_LATENCY;
+		}
+		else {
+			std::string error_str = "service " + service_name + " has malformed field \"balancing\", ";
+			error_str += "which can only take values ROUND_ROBIN, LEAST_OUTSTANDING, POWER_OF_TWO, LATENCY.";
+			throw internal_error(error_str);
+		}
+
+		// in-flight window per node
+		si.endpoint_window = service_data.get("window", defaults_t::endpoint_window).asInt();
+
+		// adaptive concurrency limit
+		const Json::Value limit = service_data["concurrency_limit"];
+		if (limit.isObject()) {
+			int max_limit = limit.get("max", static_cast<int>(defaults_t::concurrency_max)).asInt();
+			int min_limit = limit.get("min", static_cast<int>(defaults_t::concurrency_min)).asInt();
+			int initial_limit = limit.get("initial", static_cast<int>(defaults_t::concurrency_initial)).asInt();
+
+			if (min_limit <= 0 || max_limit < min_limit || initial_limit < min_limit || initial_limit > max_limit) {
+				std::string error_str = "service " + service_name + " has malformed \"concurrency_limit\" section, ";
+				error_str += "limits must satisfy 0 < min <= initial <= max.";
+				throw internal_error(error_str);
+			}
+
+			si.concurrency_limited = true;
+			si.concurrency_max = static_cast<size_t>(max_limit);
+			si.concurrency_min = static_cast<size_t>(min_limit);
+			si.concurrency_initial = static_cast<size_t>(initial_limit);
+
+			std::string overflow_str = limit.get("overflow", "QUEUE").asString();
+
+			if (overflow_str == "QUEUE") {
+				si.concurrency_overflow = LO_QUEUE;
+			}
+			else if (overflow_str == "REJECT") {
+				si.concurrency_overflow = LO_REJECT;
+			}
+			else {
+				std::string error_str = "\"concurrency_limit\" section for service " + service_name;
+				error_str += " has malformed field \"overflow\", which can only take values QUEUE, REJECT.";
+				throw internal_error(error_str);
+			}
+		}
+
+		// node capacities
+		const Json::Value weights = service_data["weights"];
+		if (weights.isObject()) {
+			const Json::Value::Members nodes = weights.getMemberNames();
+
+			for (size_t i = 0; i < nodes.size(); ++i) {
+				const Json::Value weight = weights[nodes[i]];
+
+				if (!weight.isNumeric() || weight.asDouble() <= 0.0) {
+					std::string error_str = "service " + service_name + " has malformed weight of node ";
+					error_str += nodes[i] + ", weights can only be positive numbers.";
+					throw internal_error(error_str);
+				}
+
+				si.node_weights[nodes[i]] = weight.asDouble();
+			}
+		}
+		else if (!weights.isNull()) {
+			std::string error_str = "service " + service_name + " has malformed field \"weights\", ";
+			error_str += "which can only be an object.";
+			throw internal_error(error_str);
+		}
+
 		// default message policy
 		const Json::Value mpolicy = service_data["policy"];
 		if (mpolicy.isObject()) {
@@ -277,6 +423,24 @@ configuration_t::parse_services_settings(const Json::Value& config_value) {
 			si.policy.ack_timeout = mpolicy.get("ack_timeout", defaults_t::policy_ack_timeout).asFloat();
 			si.policy.deadline = mpolicy.get("deadline", defaults_t::policy_message_deadline).asFloat();
 			si.policy.max_retries = mpolicy.get("max_retries", defaults_t::policy_max_retries).asInt();
+			si.policy.hedge_delay = mpolicy.get("hedge_delay", defaults_t::policy_hedge_delay).asFloat();
+			si.policy.hedge_percentile = mpolicy.get("hedge_percentile", defaults_t::policy_hedge_percentile).asFloat();
+
+			if (si.policy.hedge_percentile < 0.0 || si.policy.hedge_percentile >= 100.0) {
+				std::string error_str = "service " + service_name + " has malformed policy field ";
+				error_str += "\"hedge_percentile\", which can only take values in [0, 100).";
+				throw internal_error(error_str);
+			}
+
+			si.policy.retry_backoff = mpolicy.get("retry_backoff", defaults_t::policy_retry_backoff).asFloat();
+			si.policy.retry_max_backoff = mpolicy.get("retry_max_backoff", defaults_t::policy_retry_max_backoff).asFloat();
+			si.policy.retry_jitter = mpolicy.get("retry_jitter", defaults_t::policy_retry_jitter).asFloat();
+
+			if (si.policy.retry_jitter < 0.0 || si.policy.retry_jitter > 1.0) {
+				std::string error_str = "service " + service_name + " has malformed policy field ";
+				error_str += "\"retry_jitter\", which can only take values in [0, 1].";
+				throw internal_error(error_str);
+			}
 		}
 
 		// check for duplicate services
@@ -328,6 +492,7 @@ configuration_t::load(const std::string& path) {
 	try {
 		parse_basic_settings(root);
 		parse_logger_settings(root);
+		parse_dispatch_settings(root);
 		parse_services_settings(root);
 		parse_persistant_storage_settings(root);
 
@@ -443,6 +608,31 @@ configuration_t::endpoint_timeout() const {
 	return m_endpoint_timeout;
 }
 
+int
+configuration_t::io_threads_count() const {
+	return m_io_threads_count;
+}
+
+const std::vector<int>&
+configuration_t::io_threads_cpus() const {
+	return m_io_threads_cpus;
+}
+
+int
+configuration_t::dispatch_threads_count() const {
+	return m_dispatch_threads_count;
+}
+
+const std::vector<int>&
+configuration_t::dispatch_threads_cpus() const {
+	return m_dispatch_threads_cpus;
+}
+
+enum e_dispatch_sharding
+configuration_t::dispatch_sharding() const {
+	return m_dispatch_sharding;
+}
+
 const std::map<std::string, service_info_t>&
 configuration_t::services_list() const {
 	return m_services_list;
@@ -517,6 +707,23 @@ configuration_t::as_string() const {
 
 	out << "\n";
 
+	// dispatch
+	out << "dispatch\n";
+	out << "\tio threads: " << c.m_io_threads_count << "\n";
+	out << "\tworkers: " << c.m_dispatch_threads_count << "\n";
+
+	switch (c.m_dispatch_sharding) {
+		case DS_ROUND_ROBIN:
+			out << "\tsharding: ROUND_ROBIN" << "\n\n";
+			break;
+		case DS_SERVICE:
+			out << "\tsharding: SERVICE" << "\n\n";
+			break;
+		case DS_HANDLE:
+			out << "\tsharding: HANDLE" << "\n\n";
+			break;
+	}
+
  	// message cache
  	out << "message cache\n";
 
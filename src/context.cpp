@@ -21,6 +21,8 @@
 #include "cocaine/dealer/core/context.hpp"
 #include "cocaine/dealer/utils/error.hpp"
 #include "cocaine/dealer/storage/eblob_storage.hpp"
+#include "cocaine/dealer/core/reactor.hpp"
+#include "cocaine/dealer/utils/threading.hpp"
     
 namespace cocaine {
 namespace dealer {
@@ -62,14 +64,44 @@ context_t::context_t(const std::string& config_path) {
 	logger()->log(PLOG_DEBUG, "loaded config: %s", config()->config_path().c_str());
 	//logger()->log(config()->as_string());
 	
-	// create zmq context
-	m_zmq_context.reset(new zmq::context_t(1));
+	// create zmq context, io threads inherit cpu affinity of the thread
+	// that spawns them, so pin ourselves to io cpus for a moment
+	const std::vector<int>& io_cpus = m_config->io_threads_cpus();
+	std::vector<int> current_cpus;
+
+	bool pin_io_threads = !io_cpus.empty() && tutils::get_current_thread_affinity(current_cpus);
+
+	if (pin_io_threads) {
+		tutils::set_current_thread_affinity(io_cpus);
+	}
+	else if (!io_cpus.empty()) {
+		logger()->log(PLOG_WARNING, "could not pin zmq io threads to requested cpus");
+	}
+
+	m_zmq_context.reset(new zmq::context_t(m_config->io_threads_count()));
+
+	if (pin_io_threads) {
+		tutils::set_current_thread_affinity(current_cpus);
+	}
+
+	// create shared dispatch threads for handles
+	m_reactor.reset(new reactor_t(m_config->dispatch_threads_count(),
+								  m_config->dispatch_threads_cpus(),
+								  m_logger));
+
+	// user callbacks might block or call into dealer, so they get
+	// a thread of their own instead of running on dispatch threads
+	m_callbacks_worker.reset(new reactor_worker_t(m_config->dispatch_threads_count(),
+												  std::vector<int>(),
+												  m_logger));
 
 	// create statistics collector
 	//m_stats.reset(new statistics_collector(m_config, m_zmq_context, logger()));
 }
 
 context_t::~context_t() {
+	m_reactor.reset();
+	m_callbacks_worker.reset();
 	m_zmq_context.reset();
 	m_storage.reset();
 }
@@ -135,5 +167,15 @@ context_t::storage() {
 	return m_storage;
 }
 
+boost::shared_ptr<reactor_t>
+context_t::reactor() {
+	return m_reactor;
+}
+
+boost::shared_ptr<reactor_worker_t>
+context_t::callbacks_worker() {
+	return m_callbacks_worker;
+}
+
 } // namespace dealer
 } // namespace cocaine
@@ -101,6 +101,21 @@ data_container::set_data(const void* data, size_t size) {
 	signed_ = true;
 }
 
+void
+data_container::set_external_data(const void* data, size_t size, const boost::shared_ptr<void>& owner) {
+	clear();
+
+	if (data == NULL || size == 0) {
+		return;
+	}
+
+	// no sha1 signature, comparing external data falls back to memcmp
+	data_ = static_cast<unsigned char*>(const_cast<void*>(data));
+	size_ = size;
+	owner_ = owner;
+	++*ref_counter_;
+}
+
 void
 data_container::init() {
 	// reset sha1 signature
@@ -141,17 +156,23 @@ data_container::release() {
 		return;
 	}
 
-	--*ref_counter_;
-
-	if (data_ && *ref_counter_ == 0) {
+	// decrement and check must be one atomic operation,
+	// otherwise two last owners could both see zero
+	if (--*ref_counter_ == 0 && data_ && !owner_) {
 		delete [] data_;
-		data_ = NULL;
 		memset(&signature_, 0, SHA1_SIZE);
 	}
+
+	data_ = NULL;
+	owner_.reset();
 }
 
 data_container&
 data_container::operator = (const data_container& rhs) {
+	if (this == &rhs) {
+		return *this;
+	}
+
 	this->release();
 
 	data_ = rhs.data_;
@@ -163,6 +184,7 @@ data_container::operator = (const data_container& rhs) {
 	}
 
 	ref_counter_ = rhs.ref_counter_;
+	owner_ = rhs.owner_;
 	++*ref_counter_;
 
 	return *this;
@@ -185,8 +207,12 @@ data_container::operator == (const data_container& rhs) const {
 		return (0 == memcmp(data_, rhs.data_, size_));
 	}
 
-	// compare big containers
-	return (0 == memcmp(signature_, rhs.signature_, SHA1_SIZE));
+	// compare big containers, external data is not signed
+	if (signed_ && rhs.signed_) {
+		return (0 == memcmp(signature_, rhs.signature_, SHA1_SIZE));
+	}
+
+	return (0 == memcmp(data_, rhs.data_, size_));
 }
 
 bool
@@ -107,6 +107,67 @@ dealer_t::send_messages(const std::string& data,
     return m_impl->send_messages(data.data(), data.size(), path);
 }
 
+boost::shared_ptr<response_t>
+dealer_t::send_message(const message_t& message,
+                       const response_handler_t& handler)
+{
+    return m_impl->send_message(message.data.data(),
+                                message.data.size(),
+                                message.path,
+                                message.policy,
+                                handler);
+}
+
+boost::shared_ptr<response_t>
+dealer_t::send_message(const void* data,
+                       size_t size,
+                       const message_path_t& path,
+                       const message_policy_t& policy,
+                       const response_handler_t& handler)
+{
+    return m_impl->send_message(data, size, path, policy, handler);
+}
+
+boost::shared_ptr<response_t>
+dealer_t::send_message(const std::string& data,
+                       const message_path_t& path,
+                       const message_policy_t& policy,
+                       const response_handler_t& handler)
+{
+    return m_impl->send_message(data.data(), data.size(), path, policy, handler);
+}
+
+response_future_t
+dealer_t::async_send_message(const message_t& message) {
+    return m_impl->async_send_message(message.data.data(),
+                                      message.data.size(),
+                                      message.path,
+                                      message.policy);
+}
+
+response_future_t
+dealer_t::async_send_message(const void* data,
+                             size_t size,
+                             const message_path_t& path,
+                             const message_policy_t& policy)
+{
+    return m_impl->async_send_message(data, size, path, policy);
+}
+
+std::vector<response_future_t>
+dealer_t::async_send_messages(const void* data,
+                              size_t size,
+                              const message_path_t& path,
+                              const message_policy_t& policy)
+{
+    return m_impl->async_send_messages(data, size, path, policy);
+}
+
+std::vector<boost::shared_ptr<response_t> >
+dealer_t::send_batch(const std::vector<message_t>& messages) {
+    return m_impl->send_batch(messages);
+}
+
 message_policy_t
 dealer_t::policy_for_service(const std::string& service_alias) {
     return m_impl->policy_for_service(service_alias);
@@ -39,6 +39,37 @@ namespace dealer {
 
 typedef cached_message_t<persistent_data_container, persistent_request_metadata_t> p_message_t;
 
+namespace {
+
+// collects response chunks for a future, handler callbacks
+// of one response never run concurrently so no lock is needed
+class response_collector_t {
+public:
+	void on_chunk(const data_container& chunk) {
+		m_result.chunks.push_back(chunk);
+	}
+
+	void on_complete() {
+		m_promise.set_value(m_result);
+	}
+
+	void on_error(int error_code, const std::string& error_message) {
+		m_result.error_code = error_code;
+		m_result.error_message = error_message;
+		m_promise.set_value(m_result);
+	}
+
+	response_future_t future() const {
+		return m_promise.future();
+	}
+
+private:
+	response_result_t m_result;
+	promise_t<response_result_t> m_promise;
+};
+
+} // namespace
+
 dealer_impl_t::dealer_impl_t(const std::string& config_path) :
 	m_messages_cache_size(0),
 	m_is_dead(false),
@@ -173,15 +204,17 @@ boost::shared_ptr<response_t>
 dealer_impl_t::send_message(const void* data,
 							size_t size,
 							const message_path_t& path,
-							const message_policy_t& policy)
+							const message_policy_t& policy,
+							const response_handler_t& handler)
 {
 	BOOST_VERIFY(!m_is_dead);
-	
-	boost::mutex::scoped_lock lock(m_mutex);
+
+	// services map is never modified while dealer is alive, so no lock
+	// is needed here, services and handles synchronize on their own
 	boost::shared_ptr<service_t> service = get_service(path.service_alias);
 	boost::shared_ptr<message_iface> msg = create_message(data, size, path, policy);
 
-	return service->send_message(msg);
+	return service->send_message(msg, handler);
 }
 
 std::vector<boost::shared_ptr<response_t> >
@@ -229,6 +262,102 @@ dealer_impl_t::send_messages(const void* data,
 	return responces_list;
 }
 
+response_future_t
+dealer_impl_t::async_send_message(const void* data,
+								  size_t size,
+								  const message_path_t& path,
+								  const message_policy_t& policy)
+{
+	boost::shared_ptr<response_collector_t> collector(new response_collector_t);
+
+	response_handler_t handler(boost::bind(&response_collector_t::on_chunk, collector, _1),
+							   boost::bind(&response_collector_t::on_complete, collector),
+							   boost::bind(&response_collector_t::on_error, collector, _1, _2));
+
+	send_message(data, size, path, policy, handler);
+
+	return collector->future();
+}
+
+std::vector<response_future_t>
+dealer_impl_t::async_send_messages(const void* data,
+								   size_t size,
+								   const message_path_t& path,
+								   const message_policy_t& policy)
+{
+	std::vector<response_future_t> futures;
+
+	const configuration_t::services_list_t& services_info_list = config()->services_list();
+	configuration_t::services_list_t::const_iterator it = services_info_list.begin();
+	for (; it != services_info_list.end(); ++it) {
+		if (regex_match(path.service_alias, it->second.name)) {
+			message_path_t exact_path = path;
+			exact_path.service_alias = it->second.name;
+
+			futures.push_back(async_send_message(data, size, exact_path, policy));
+		}
+	}
+
+	return futures;
+}
+
+std::vector<boost::shared_ptr<response_t> >
+dealer_impl_t::send_batch(const std::vector<message_t>& messages) {
+	BOOST_VERIFY(!m_is_dead);
+
+	std::vector<boost::shared_ptr<response_t> > responses(messages.size());
+
+	// positions of messages in batch for each service
+	typedef std::map<std::string, std::vector<size_t> > services_batches_t;
+	services_batches_t services_batches;
+
+	for (size_t i = 0; i < messages.size(); ++i) {
+		services_batches[messages[i].path.service_alias].push_back(i);
+	}
+
+	// resolve all services first, so that nothing is sent if one is missing
+	std::vector<service_ptr_t> services;
+
+	services_batches_t::iterator it = services_batches.begin();
+	for (; it != services_batches.end(); ++it) {
+		services.push_back(get_service(it->first));
+	}
+
+	it = services_batches.begin();
+	for (size_t i = 0; it != services_batches.end(); ++it, ++i) {
+		const std::vector<size_t>& positions = it->second;
+		service_t::cached_messages_deque_t service_messages;
+
+		// storage of service is looked up once for whole group
+		boost::shared_ptr<eblob_t> eb;
+
+		for (size_t j = 0; j < positions.size(); ++j) {
+			const message_t& message = messages[positions[j]];
+
+			if (config()->message_cache_type() == PERSISTENT &&
+				message.policy.persistent == true &&
+				!eb)
+			{
+				eb = context()->storage()->get_eblob(it->first);
+			}
+
+			service_messages.push_back(create_message(message.data.data(),
+													  message.data.size(),
+													  message.path,
+													  message.policy,
+													  eb));
+		}
+
+		responses_list_t service_responses = services[i]->send_messages(service_messages);
+
+		for (size_t j = 0; j < positions.size(); ++j) {
+			responses[positions[j]] = service_responses[j];
+		}
+	}
+
+	return responses;
+}
+
 message_policy_t
 dealer_impl_t::policy_for_service(const std::string& service_alias) {
 	boost::shared_ptr<service_t> service;
@@ -293,6 +422,24 @@ dealer_impl_t::create_message(const void* data,
 							  size_t size,
 							  const message_path_t& path,
 							  const message_policy_t& policy)
+{
+	boost::shared_ptr<eblob_t> eb;
+
+	if (config()->message_cache_type() == PERSISTENT &&
+		policy.persistent == true)
+	{
+		eb = context()->storage()->get_eblob(path.service_alias);
+	}
+
+	return create_message(data, size, path, policy, eb);
+}
+
+boost::shared_ptr<message_iface>
+dealer_impl_t::create_message(const void* data,
+							  size_t size,
+							  const message_path_t& path,
+							  const message_policy_t& policy,
+							  boost::shared_ptr<eblob_t> eb)
 {
 	typedef cached_message_t<data_container, request_metadata_t> msg_t;
 	boost::shared_ptr<message_iface> msg(new msg_t(path,
@@ -300,10 +447,7 @@ dealer_impl_t::create_message(const void* data,
 												   data,
 												   size));
 
-	if (config()->message_cache_type() == PERSISTENT &&
-		policy.persistent == true)
-	{
-		boost::shared_ptr<eblob_t> eb = context()->storage()->get_eblob(path.service_alias);
+	if (eb) {
 		msg->commit_to_eblob(eb);
 		log(PLOG_DEBUG,
 			"commited message with uuid: %s to persistent storage.",
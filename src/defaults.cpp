@@ -27,7 +27,14 @@ const std::string defaults_t::eblob_path		= "/tmp/pmq_eblob";
 const float defaults_t::policy_ack_timeout		= 0.05; // seconds
 const float defaults_t::policy_chunk_timeout	= 0.0;  // seconds
 const float defaults_t::policy_message_deadline	= 0.0;  // seconds
+const float defaults_t::policy_hedge_delay		= 0.0;  // seconds
+const float defaults_t::policy_hedge_percentile	= 0.0;
+const float defaults_t::policy_retry_backoff	= 0.01; // seconds
+const float defaults_t::policy_retry_max_backoff = 1.0; // seconds
+const float defaults_t::policy_retry_jitter		= 0.5;
 const float defaults_t::endpoint_timeout        = 2.0;  // seconds
+const float defaults_t::circuit_ejection_time	= 0.5;  // seconds
+const float defaults_t::circuit_max_ejection_time = 30.0; // seconds
 
 } // namespace dealer
 } // namespace cocaine
@@ -20,6 +20,7 @@
 
 #include <algorithm>
 
+#include <boost/bind.hpp>
 #include <boost/lexical_cast.hpp>
 
 #include "cocaine/dealer/core/handle.hpp"
@@ -31,16 +32,26 @@
 namespace cocaine {
 namespace dealer {
 
+namespace {
+	// max messages or responses processed per loop iteration
+	const int dispatch_batch_size = 100;
+}
+
 handle_t::handle_t(const handle_info_t& info,
 				   const std::set<cocaine_endpoint_t>& endpoints,
 				   const boost::shared_ptr<context_t>& ctx,
 				   bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
 	m_info(info),
-	m_endpoints(endpoints),
 	m_is_running(false),
 	m_is_connected(false),
-	m_receiving_control_socket_ok(false)
+	m_endpoints(endpoints),
+	m_receiving_control_socket_ok(false),
+	m_deadline_timer_expiration(0.0),
+	m_reply_latencies_next(0),
+	m_hedge_percentile(0.0),
+	m_hedge_percentile_delay(0.0),
+	m_reply_latencies_added(0)
 {
 	log(PLOG_DEBUG, "CREATED HANDLE " + description());
 
@@ -55,9 +66,25 @@ handle_t::handle_t(const handle_info_t& info,
 	m_zmq_control_socket->setsockopt(ZMQ_LINGER, &timeout, sizeof(timeout));
 	m_zmq_control_socket->bind(conn_str.c_str());
 
-	// run message dispatch thread
+	// attach to one of the shared dispatch threads
+	boost::shared_ptr<reactor_t> reactor = context()->reactor();
+
+	switch (config()->dispatch_sharding()) {
+		case DS_SERVICE:
+			m_worker = reactor->worker_for(m_info.service_alias);
+			break;
+
+		case DS_HANDLE:
+			m_worker = reactor->worker_for(m_info.as_string());
+			break;
+
+		default:
+			m_worker = reactor->next_worker();
+			break;
+	}
+
 	m_is_running = true;
-	m_thread = boost::thread(&handle_t::dispatch_messages, this);
+	m_worker->execute(boost::bind(&handle_t::attach, this));
 }
 
 handle_t::~handle_t() {
@@ -91,96 +118,195 @@ handle_t::kill() {
 
 	m_is_running = false;
 
+	// stop message dispatch, finalize everything
+	m_worker->execute(boost::bind(&handle_t::detach, this));
+
 	m_zmq_control_socket->close();
 	m_zmq_control_socket.reset(NULL);
 
-	m_thread.join();
-
 	log(PLOG_DEBUG, "KILLED HANDLE " + description());
 }
 
 void
-handle_t::dispatch_messages() {
+handle_t::attach() {
 	wuuid_t balancer_uuid;
 	balancer_uuid.generate();
 	std::string balancer_ident = m_info.as_string() + "." + balancer_uuid.as_human_readable_string();
 
-	balancer_t balancer(balancer_ident, m_endpoints, context());
+	// handles of one worker share one zmq io thread
+	uint64_t io_affinity = 0;
+	int io_threads_count = config()->io_threads_count();
+
+	if (io_threads_count > 1) {
+		size_t io_thread = m_worker->index() % std::min(io_threads_count, 64);
+		io_affinity = 1ULL << io_thread;
+	}
+
+	m_balancer.reset(new balancer_t(balancer_ident, m_endpoints, context(), io_affinity));
+
+	// per-route counts of unfinished messages come from the cache
+	const configuration_t::services_list_t& services = config()->services_list();
+	configuration_t::services_list_t::const_iterator sit = services.find(m_info.service_alias);
+
+	if (sit != services.end()) {
+		balancer_t::outstanding_counter_t counter;
+		counter = boost::bind(&message_cache_t::sent_messages_count_for_route, m_message_cache.get(), _1);
+		m_balancer->set_balancing_policy(sit->second.balancing_policy, counter);
+	}
+
 	m_is_connected = true;
 
-	socket_ptr_t control_socket;
-	establish_control_conection(control_socket);
+	establish_control_conection(m_control_socket);
+
+	ev::dynamic_loop& loop = m_worker->loop();
+
+	m_socket_watcher.reset(new ev::io(loop));
+	m_socket_watcher->set<handle_t, &handle_t::guarded_callback<ev::io, &handle_t::on_socket_event> >(this);
+	m_socket_watcher->start(m_balancer->fd(), ev::READ);
+
+	m_prepare.reset(new ev::prepare(loop));
+	m_prepare->set<handle_t, &handle_t::guarded_callback<ev::prepare, &handle_t::on_prepare> >(this);
+	m_prepare->start();
+
+	// new messages are enqueued from other threads, they wake us up
+	m_wakeup.reset(new ev::async(loop));
+	m_wakeup->set<handle_t, &handle_t::guarded_callback<ev::async, &handle_t::on_wakeup> >(this);
+	m_wakeup->start();
+
+	// control messages are handled as soon as they arrive
+	int control_fd = -1;
+	size_t control_fd_size = sizeof(control_fd);
+	m_control_socket->getsockopt(ZMQ_FD, &control_fd, &control_fd_size);
+
+	m_control_watcher.reset(new ev::io(loop));
+	m_control_watcher->set<handle_t, &handle_t::guarded_callback<ev::io, &handle_t::on_control_event> >(this);
+	m_control_watcher->start(control_fd, ev::READ);
+
+	// armed for the earliest message deadline or ack timeout
+	m_deadline_timer.reset(new ev::timer(loop));
+	m_deadline_timer->set<handle_t, &handle_t::guarded_callback<ev::timer, &handle_t::on_deadline_timer> >(this);
+	m_deadline_timer_expiration = 0.0;
 
 	log(PLOG_DEBUG, "started message dispatch for " + description());
+}
 
-	m_last_response_timer.reset();
-	m_deadlined_messages_timer.reset();
-	m_control_messages_timer.reset();
+void
+handle_t::detach() {
+	m_deadline_timer->stop();
+	m_deadline_timer.reset();
 
-	// process messages
-	while (m_is_running) {
-		// process incoming control messages every 200 msec
-		int control_message = 0;
-		              
-		if (m_control_messages_timer.elapsed().as_double() > 0.2f) {
-		      control_message = receive_control_messages(control_socket, 0);
-		      m_control_messages_timer.reset();
-		}
+	m_control_watcher->stop();
+	m_control_watcher.reset();
+
+	// client threads might still signal it, so it's only destroyed with handle
+	m_wakeup->stop();
+
+	m_prepare->stop();
+	m_prepare.reset();
+
+	m_socket_watcher->stop();
+	m_socket_watcher.reset();
+
+	m_control_socket.reset();
+
+	m_is_connected = false;
+	m_balancer.reset();
+
+	log(PLOG_DEBUG, "finished message dispatch for " + description());
+}
+
+void
+handle_t::on_socket_event(ev::io& watcher, int type) {
+	if (!m_is_running || !m_is_connected) {
+		return;
+	}
 
-		if (control_message == CONTROL_MESSAGE_KILL) {
-			// stop message dispatch, finalize everything
-			m_is_running = false;
+	// process received responce(s), limited so that
+	// other handles on this thread get their turn
+	for (int i = 0; i < dispatch_batch_size; ++i) {
+		if (!m_balancer->check_for_responses(0)) {
 			break;
 		}
-		else if (control_message > 0) {
-			dispatch_control_messages(control_message, balancer);
-		}
 
-		// send new message if any
-		if (m_is_running && m_is_connected) {
-			for (int i = 0; i < 100; ++i) { // batching
-				if (m_message_cache->new_messages_count() == 0) {
-					break;
-				}
+		dispatch_next_available_response(*m_balancer);
+	}
+}
 
-				dispatch_next_available_message(balancer);
-			}
+void
+handle_t::on_prepare(ev::prepare& watcher, int type) {
+	if (!m_is_running || !m_is_connected) {
+		return;
+	}
+
+	// send new messages if any
+	int sent_count = 0;
+	for (; sent_count < dispatch_batch_size; ++sent_count) {
+		if (!dispatch_next_available_message(*m_balancer)) {
+			break;
 		}
+	}
 
-		// check for message responces
-		bool received_response = false;
+	// zmq socket descriptor is edge-triggered, so don't block the loop
+	// while there are unread responses or unsent messages left
+	bool has_more_messages = (sent_count == dispatch_batch_size &&
+							  m_message_cache->new_messages_count() > 0);
 
-		int fast_poll_timeout = 30;		  // microsecs
-		int long_poll_timeout = 300000;   // microsecs
+	if (has_more_messages || m_balancer->check_for_responses(0)) {
+		m_worker->loop().feed_fd_event(m_balancer->fd(), ev::READ);
+	}
 
-		int response_poll_timeout = fast_poll_timeout;
-		if (m_last_response_timer.elapsed().as_double() > 5.0f) {
-			response_poll_timeout = long_poll_timeout;
-		}
+	update_deadline_timer();
+}
 
-		if (m_is_connected && m_is_running) {
-			received_response = balancer.check_for_responses(response_poll_timeout);
+void
+handle_t::update_deadline_timer() {
+	double expiration = m_message_cache->next_expiration_time();
 
-			// process received responce(s)
-			while (received_response) {
-				m_last_response_timer.reset();
-				response_poll_timeout = fast_poll_timeout;
+	// already armed for it
+	if (expiration == m_deadline_timer_expiration) {
+		return;
+	}
 
-				dispatch_next_available_response(balancer);
-				received_response = balancer.check_for_responses(response_poll_timeout);
-			}
-		}
+	m_deadline_timer->stop();
+	m_deadline_timer_expiration = expiration;
 
-		if (m_is_running) {
-			if (m_deadlined_messages_timer.elapsed().as_double() > 1.0f) {
-				process_deadlined_messages();
-				m_deadlined_messages_timer.reset();
-			}
+	if (expiration <= 0.0) {
+		return;
+	}
+
+	double delay = expiration - time_value::get_current_time().as_double();
+	m_deadline_timer->start(std::max(delay, 0.0), 0.0);
+}
+
+void
+handle_t::on_wakeup(ev::async& watcher, int type) {
+	// nothing to do here, new messages are sent from on_prepare()
+}
+
+void
+handle_t::on_control_event(ev::io& watcher, int type) {
+	// zmq socket descriptor is edge-triggered, read everything
+	while (m_is_running) {
+		int control_message = receive_control_messages(m_control_socket, 0);
+
+		if (control_message <= 0) {
+			break;
 		}
+
+		dispatch_control_messages(control_message, *m_balancer);
 	}
+}
 
-	control_socket.reset();
-	log(PLOG_DEBUG, "finished message dispatch for " + description());
+void
+handle_t::on_deadline_timer(ev::timer& watcher, int type) {
+	// one-shot, gets rearmed from on_prepare()
+	m_deadline_timer_expiration = 0.0;
+
+	if (!m_is_running) {
+		return;
+	}
+
+	process_deadlined_messages();
 }
 
 void
@@ -221,6 +347,85 @@ handle_t::remove_from_persistent_storage(wuuid_t& uuid,
 	eb->remove_all(uuid.as_string());
 }
 
+double
+handle_t::hedge_delay(const message_policy_t& policy) {
+	if (policy.hedge_percentile <= 0.0 || m_reply_latencies.size() < min_reply_latencies) {
+		return policy.hedge_delay;
+	}
+
+	if (policy.hedge_percentile == m_hedge_percentile &&
+		m_reply_latencies_added < hedge_recompute_interval)
+	{
+		return m_hedge_percentile_delay;
+	}
+
+	m_sorted_latencies.assign(m_reply_latencies.begin(), m_reply_latencies.end());
+	size_t n = static_cast<size_t>(policy.hedge_percentile / 100.0 * (m_sorted_latencies.size() - 1));
+
+	std::nth_element(m_sorted_latencies.begin(), m_sorted_latencies.begin() + n, m_sorted_latencies.end());
+
+	m_hedge_percentile = policy.hedge_percentile;
+	m_hedge_percentile_delay = m_sorted_latencies[n];
+	m_reply_latencies_added = 0;
+
+	return m_hedge_percentile_delay;
+}
+
+void
+handle_t::add_reply_latency(double latency) {
+	++m_reply_latencies_added;
+
+	if (m_reply_latencies.size() < reply_latencies_size) {
+		m_reply_latencies.push_back(latency);
+		return;
+	}
+
+	m_reply_latencies[m_reply_latencies_next] = latency;
+	m_reply_latencies_next = (m_reply_latencies_next + 1) % reply_latencies_size;
+}
+
+bool
+handle_t::claim_reply_route(const boost::shared_ptr<response_chunk_t>& response) {
+	boost::shared_ptr<message_iface> message;
+
+	// finished or unknown message, service sorts its chunks out
+	if (!m_message_cache->get_sent_message(response->route, response->uuid, message)) {
+		return true;
+	}
+
+	// first copy to reply wins
+	if (message->reply_route().empty()) {
+		message->set_reply_route(response->route);
+	}
+
+	return message->reply_route() == response->route;
+}
+
+void
+handle_t::hedge_message(boost::shared_ptr<message_iface>& message) {
+	cocaine_endpoint_t endpoint;
+
+	if (!m_balancer->send_hedge(message, message->destination_route(), endpoint)) {
+		return;
+	}
+
+	m_message_cache->add_hedged_message(endpoint.route, message);
+
+	if (log_flag_enabled(PLOG_DEBUG)) {
+		log(PLOG_DEBUG,
+			"sent hedged copy of msg with uuid: %s to endpoint: %s with route: %s (%s)",
+			message->uuid().as_human_readable_string().c_str(),
+			endpoint.endpoint.c_str(),
+			endpoint.route.c_str(),
+			description().c_str());
+	}
+}
+
+double
+handle_t::time_since_sent(const boost::shared_ptr<message_iface>& message) {
+	return time_value::get_current_time().as_double() - message->sent_timestamp().as_double();
+}
+
 void
 handle_t::dispatch_next_available_response(balancer_t& balancer) {
 	boost::shared_ptr<response_chunk_t> response;
@@ -232,24 +437,75 @@ handle_t::dispatch_next_available_response(balancer_t& balancer) {
 	boost::shared_ptr<message_iface> sent_msg;
 
 	switch (response->rpc_code) {
-		case SERVER_RPC_MESSAGE_ACK:		
+		case SERVER_RPC_MESSAGE_ACK:
 			if (m_message_cache->get_sent_message(response->route, response->uuid, sent_msg)) {
 				sent_msg->set_ack_received(true);
+
+				// sent time is known for the original message only, not for hedged copy
+				if (response->route == sent_msg->destination_route()) {
+					balancer.update_ack_latency(response->route, time_since_sent(sent_msg));
+				}
 			}
 		break;
 
 		case SERVER_RPC_MESSAGE_CHUNK:
-			enqueue_response(response);
+			if (claim_reply_route(response)) {
+				enqueue_response(response);
+			}
 		break;
 
 		case SERVER_RPC_MESSAGE_CHOKE:
+			// node that acks and then fails every message is not healthy,
+			// so only finished messages count as success
+			balancer.report_success(response->route, response->uuid);
+
+			// copy of hedged message that lost, the winner is still running
+			if (!claim_reply_route(response)) {
+				m_message_cache->remove_message_copy(response->route, response->uuid);
+				break;
+			}
+
 			enqueue_response(response);
 
+			if (m_message_cache->get_sent_message(response->route, response->uuid, sent_msg) &&
+				response->route == sent_msg->destination_route())
+			{
+				double latency = time_since_sent(sent_msg);
+
+				balancer.update_choke_latency(response->route, latency);
+				add_reply_latency(latency);
+			}
+
 			remove_from_persistent_storage(response);
 			m_message_cache->remove_message_from_cache(response->route, response->uuid);
 		break;
 		
 		case SERVER_RPC_MESSAGE_ERROR: {
+			// failures of the node itself, not of the request or app code
+			if (response->error_code == resource_error ||
+				response->error_code == server_error ||
+				response->error_code == location_error)
+			{
+				balancer.report_failure(response->route, response->uuid);
+			}
+
+			// other copies of hedged message may still succeed, unless this one
+			// already passed its chunks on, then nothing can replace it
+			if (m_message_cache->sent_copies_count(response->uuid) > 1) {
+				if (!m_message_cache->get_sent_message(response->route, response->uuid, sent_msg) ||
+					sent_msg->reply_route() != response->route)
+				{
+					m_message_cache->remove_message_copy(response->route, response->uuid);
+					break;
+				}
+
+				enqueue_response(response);
+
+				remove_from_persistent_storage(response);
+				m_message_cache->remove_message_from_cache(response->route, response->uuid);
+				break;
+			}
+
 			// handle resource error
 			if (response->error_code == resource_error) {
 				if (m_message_cache->reshedule_message(response->route, response->uuid)) {
@@ -355,7 +611,12 @@ void
 handle_t::process_deadlined_messages() {
 	assert(m_message_cache);
 	message_cache_t::message_queue_t expired_messages;
-	m_message_cache->get_expired_messages(expired_messages);
+	message_cache_t::message_queue_t hedge_messages;
+	m_message_cache->get_expired_messages(expired_messages, hedge_messages);
+
+	for (size_t i = 0; i < hedge_messages.size(); ++i) {
+		hedge_message(hedge_messages[i]);
+	}
 
 	if (expired_messages.empty()) {
 		return;
@@ -396,10 +657,14 @@ handle_t::process_deadlined_messages() {
 			}
 		}
 		else if (expired_messages.at(i)->is_ack_timedout()) {
+			m_balancer->report_failure(expired_messages.at(i)->destination_route(),
+									   expired_messages.at(i)->uuid());
+
 			if (expired_messages.at(i)->can_retry()) {
 				expired_messages.at(i)->increment_retries_count();
 				expired_messages.at(i)->reset_ack_timedout();
-				m_message_cache->enqueue_with_priority(expired_messages.at(i));
+				m_message_cache->schedule_retry(expired_messages.at(i),
+												expired_messages.at(i)->destination_route());
 
 				if (log_flag_enabled(PLOG_WARNING)) {
 					std::string log_str = "no ACK, rescheduled message %s, (enqued: %s, sent: %s, curr: %s)";
@@ -525,7 +790,7 @@ handle_t::dispatch_next_available_message(balancer_t& balancer) {
 	cocaine_endpoint_t endpoint;
 	if (balancer.send(new_msg, endpoint)) {
 		new_msg->mark_as_sent(true);
-		m_message_cache->move_new_message_to_sent(endpoint.route);
+		m_message_cache->move_new_message_to_sent(endpoint.route, hedge_delay(new_msg->policy()));
 
 		if (log_flag_enabled(PLOG_DEBUG)) {
 			std::string log_msg = "sent msg with uuid: %s to endpoint: %s with route: %s (%s)";
@@ -541,8 +806,14 @@ handle_t::dispatch_next_available_message(balancer_t& balancer) {
 
 		return true;
 	}
-	else {
-		log(PLOG_ERROR, "dispatch_next_available_message failed");		
+	else if (!balancer.has_alive_endpoints()) {
+		// ordinary during outages, message waits for endpoints to come back
+		if (log_flag_enabled(PLOG_DEBUG)) {
+			log(PLOG_DEBUG, "no alive endpoints to dispatch message to (%s)", description().c_str());
+		}
+	}
+	else if (!balancer.is_saturated()) {
+		log(PLOG_ERROR, "dispatch_next_available_message failed");
 	}
 
 	return false;
@@ -585,6 +856,7 @@ void
 handle_t::assign_message_queue(const message_cache_t::message_queue_ptr_t& message_queue) {
 	assert (m_message_cache);
 	m_message_cache->append_message_queue(message_queue);
+	wake_up();
 }
 
 void
@@ -596,6 +868,16 @@ handle_t::set_responce_callback(responce_callback_t callback) {
 void
 handle_t::enqueue_message(const boost::shared_ptr<message_iface>& message) {
 	m_message_cache->enqueue(message);
+	wake_up();
+}
+
+void
+handle_t::wake_up() {
+	// ev::async is safe to signal from any thread,
+	// repeated signals are coalesced until the loop handles them
+	if (m_is_running && m_wakeup.get()) {
+		m_wakeup->send();
+	}
 }
 
 } // namespace dealer
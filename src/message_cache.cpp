@@ -22,9 +22,12 @@
 #include <stdexcept>
 #include <uuid/uuid.h>
 #include <map>
+#include <set>
 #include <cstring>
 #include <algorithm>
 #include <iostream>
+#include <cstdlib>
+#include <ctime>
 
 #include <boost/bind.hpp>
 #include <boost/tokenizer.hpp>
@@ -39,17 +42,193 @@ namespace dealer {
 message_cache_t::message_cache_t(const boost::shared_ptr<context_t>& ctx,
 							 bool logging_enabled) :
 	dealer_object_t(ctx, logging_enabled),
-	m_locked(false)
+	m_locked(false),
+	m_incoming(NULL)
 {
+	m_random_seed = static_cast<unsigned int>(time(NULL)) ^ static_cast<unsigned int>(reinterpret_cast<size_t>(this));
 	m_type = config()->message_cache_type();
 	m_new_messages.reset(new message_queue_t);
 }
 
 message_cache_t::~message_cache_t() {
+	incoming_message_t* node = __sync_lock_test_and_set(&m_incoming, NULL);
+
+	while (node) {
+		incoming_message_t* next = node->next;
+		delete node;
+		node = next;
+	}
+}
+
+void
+message_cache_t::push_incoming(incoming_message_t* top, incoming_message_t* bottom) {
+	incoming_message_t* head;
+
+	do {
+		head = m_incoming;
+		bottom->next = head;
+	}
+	while (!__sync_bool_compare_and_swap(&m_incoming, head, top));
+}
+
+void
+message_cache_t::fetch_incoming() {
+	// cheap check first, to avoid locked instruction when there's nothing new
+	if (m_incoming == NULL) {
+		return;
+	}
+
+	// take everything at once, no ABA since nodes are never popped one by one
+	incoming_message_t* node = __sync_lock_test_and_set(&m_incoming, NULL);
+
+	// stack holds messages newest first, restore enqueue order
+	incoming_message_t* reversed = NULL;
+	while (node) {
+		incoming_message_t* next = node->next;
+		node->next = reversed;
+		reversed = node;
+		node = next;
+	}
+
+	while (reversed) {
+		incoming_message_t* next = reversed->next;
+		m_new_messages->push_back(reversed->message);
+		schedule_deadline(reversed->message);
+		delete reversed;
+		reversed = next;
+	}
+}
+
+void
+message_cache_t::schedule_deadline(const cached_message_ptr_t& message) {
+	double deadline = message->policy().deadline;
+
+	if (deadline <= 0.0) {
+		return;
+	}
+
+	expiration_t expiration;
+	expiration.time = message->enqued_timestamp().as_double() + deadline;
+	expiration.type = DEADLINE_EXPIRATION;
+	expiration.sent_time = 0.0;
+	expiration.message = message;
+
+	push_expiration(expiration);
+}
+
+void
+message_cache_t::schedule_ack_timeout(const cached_message_ptr_t& message) {
+	expiration_t expiration;
+	expiration.sent_time = message->sent_timestamp().as_double();
+	expiration.time = expiration.sent_time + message->policy().ack_timeout;
+	expiration.type = ACK_EXPIRATION;
+	expiration.message = message;
+
+	push_expiration(expiration);
+}
+
+void
+message_cache_t::push_expiration(const expiration_t& expiration) {
+	m_expirations.push_back(expiration);
+	std::push_heap(m_expirations.begin(), m_expirations.end(), std::greater<expiration_t>());
+
+	// every cached message has at most deadline, ack and hedge or retry entries
+	size_t cached_count = m_new_messages->size() + m_sent_messages.size() + m_retry_messages.size();
+	size_t limit = 3 * cached_count * expirations_slack;
+
+	if (m_expirations.size() > limit && m_expirations.size() > min_expirations_purge_size) {
+		purge_stale_expirations();
+	}
+}
+
+void
+message_cache_t::pop_expiration() {
+	std::pop_heap(m_expirations.begin(), m_expirations.end(), std::greater<expiration_t>());
+	m_expirations.pop_back();
+}
+
+bool
+message_cache_t::is_stale_expiration(const expiration_t& expiration) const {
+	boost::shared_ptr<message_iface> msg = expiration.message.lock();
+
+	if (!msg) {
+		return true;
+	}
+
+	switch (expiration.type) {
+		case RETRY_EXPIRATION:
+			return m_retry_messages.find(msg) == m_retry_messages.end();
+
+		case ACK_EXPIRATION:
+		case HEDGE_EXPIRATION:
+			return (msg->is_deadlined() ||
+					!msg->is_sent() ||
+					(expiration.type == ACK_EXPIRATION && msg->ack_received()) ||
+					msg->sent_timestamp().as_double() != expiration.sent_time);
+
+		default:
+			return msg->is_deadlined();
+	}
+}
+
+void
+message_cache_t::purge_stale_expirations() {
+	m_expirations.erase(std::remove_if(m_expirations.begin(),
+									   m_expirations.end(),
+									   boost::bind(&message_cache_t::is_stale_expiration, this, _1)),
+						m_expirations.end());
+
+	std::make_heap(m_expirations.begin(), m_expirations.end(), std::greater<expiration_t>());
+}
+
+double
+message_cache_t::retry_backoff(const cached_message_ptr_t& message) {
+	const message_policy_t& policy = message->policy();
+
+	if (policy.retry_backoff <= 0.0) {
+		return 0.0;
+	}
+
+	// first retry waits retry_backoff, every next one twice as long
+	double delay = policy.retry_backoff;
+	for (int i = 1; i < message->retries_count(); ++i) {
+		if (policy.retry_max_backoff > 0.0 && delay >= policy.retry_max_backoff) {
+			break;
+		}
+
+		delay *= 2.0;
+	}
+
+	if (policy.retry_max_backoff > 0.0) {
+		delay = std::min(delay, policy.retry_max_backoff);
+	}
+
+	// spreads retries of messages that failed at the same moment
+	double random = static_cast<double>(rand_r(&m_random_seed)) / RAND_MAX;
+	return delay * (1.0 - policy.retry_jitter * random);
+}
+
+double
+message_cache_t::next_expiration_time() const {
+	if (m_expirations.empty()) {
+		return 0.0;
+	}
+
+	return m_expirations.front().time;
 }
 
 message_cache_t::message_queue_ptr_t
 message_cache_t::new_messages() {
+	fetch_incoming();
+
+	// deadlined messages were already reported, don't hand them over
+	if (m_new_messages) {
+		m_new_messages->erase(std::remove_if(m_new_messages->begin(),
+											 m_new_messages->end(),
+											 boost::bind(&message_iface::is_deadlined, _1)),
+							  m_new_messages->end());
+	}
+
 	if (!m_new_messages) {
 		std::string error_str = "new messages queue object is empty at ";
 		error_str += std::string(BOOST_CURRENT_FUNCTION);
@@ -61,53 +240,76 @@ message_cache_t::new_messages() {
 
 void
 message_cache_t::enqueue_with_priority(const boost::shared_ptr<message_iface>& message) {
-	boost::mutex::scoped_lock lock(m_mutex);
+	fetch_incoming();
+
+	message->mark_as_sent(false);
+	message->set_ack_received(false);
 	m_new_messages->push_front(message);
 }
 
 void
 message_cache_t::enqueue(const boost::shared_ptr<message_iface>& message) {
-	boost::mutex::scoped_lock lock(m_mutex);
-	m_new_messages->push_back(message);
+	incoming_message_t* node = new incoming_message_t;
+	node->message = message;
+	push_incoming(node, node);
 }
 
 void
 message_cache_t::append_message_queue(message_queue_ptr_t queue) {
-	boost::mutex::scoped_lock lock(m_mutex);
-
 	// validate new queue
 	if (!queue || queue->empty()) {
 		return;
 	}
 
-	// append messages
-	m_new_messages->insert(m_new_messages->end(), queue->begin(), queue->end());
+	// link messages newest first and push them with a single swap
+	incoming_message_t* top = NULL;
+	incoming_message_t* bottom = NULL;
+
+	for (message_queue_t::iterator it = queue->begin(); it != queue->end(); ++it) {
+		incoming_message_t* node = new incoming_message_t;
+		node->message = *it;
+		node->next = top;
+		top = node;
+
+		if (!bottom) {
+			bottom = node;
+		}
+	}
+
+	push_incoming(top, bottom);
 }
 
 boost::shared_ptr<message_iface>
 message_cache_t::get_new_message() {
-	boost::mutex::scoped_lock lock(m_mutex);
+	fetch_incoming();
+	drop_deadlined_new_messages();
 	return m_new_messages->front();
 }
 
 size_t
 message_cache_t::new_messages_count() {
-	boost::mutex::scoped_lock lock(m_mutex);
+	fetch_incoming();
+	drop_deadlined_new_messages();
 	return m_new_messages->size();
 }
 
+void
+message_cache_t::drop_deadlined_new_messages() {
+	// deadlined messages are left in queue by get_expired_messages()
+	// and dropped once they reach its front
+	while (!m_new_messages->empty() && m_new_messages->front()->is_deadlined()) {
+		m_new_messages->pop_front();
+	}
+}
+
 size_t
 message_cache_t::sent_messages_count() {
-	boost::mutex::scoped_lock lock(m_mutex);
-
-	size_t sent_messages_count = 0;
-
-	route_sent_messages_map_t::const_iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-		sent_messages_count += it->second.size();
-	}
+	return m_sent_messages.size();
+}
 
-	return sent_messages_count;
+size_t
+message_cache_t::sent_messages_count_for_route(const std::string& route) const {
+	return m_sent_messages.route_size(route);
 }
 
 bool
@@ -115,78 +317,68 @@ message_cache_t::get_sent_message(const std::string& route,
 								  wuuid_t& uuid,
 								  boost::shared_ptr<message_iface>& message)
 {
-	boost::mutex::scoped_lock lock(m_mutex);
-
-	route_sent_messages_map_t::const_iterator it = m_sent_messages.find(route);
-
-	if (it == m_sent_messages.end()) {
+	if (!m_sent_messages.find(uuid, route, message)) {
 		return false;
 	}
 
-	const sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::const_iterator mit = msg_map.find(uuid.as_string());
-
-	if (mit == msg_map.end()) {
-		return false;
-	}
-
-	assert(mit->second);
-	message = mit->second;
-
+	assert(message);
 	return true;
 }
 
 void
-message_cache_t::move_new_message_to_sent(const std::string& route) {
-	boost::mutex::scoped_lock lock(m_mutex);
+message_cache_t::move_new_message_to_sent(const std::string& route, double hedge_delay) {
+	fetch_incoming();
 
 	boost::shared_ptr<message_iface> msg = m_new_messages->front();
 	assert(msg);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-	if (it == m_sent_messages.end()) {
-		sent_messages_map_t msg_map;
-		msg_map.insert(std::make_pair(msg->uuid().as_string(), msg));
-		m_sent_messages[route] = msg_map;
-	}
-	else {
-		it->second.insert(std::make_pair(msg->uuid().as_string(), msg));
-	}
+	msg->set_destination_route(route);
+	m_sent_messages.insert(route, msg);
 
 	m_new_messages->pop_front();
+	schedule_ack_timeout(msg);
+
+	if (hedge_delay > 0.0) {
+		expiration_t expiration;
+		expiration.sent_time = msg->sent_timestamp().as_double();
+		expiration.time = expiration.sent_time + hedge_delay;
+		expiration.type = HEDGE_EXPIRATION;
+		expiration.message = msg;
+
+		push_expiration(expiration);
+	}
 }
 
-bool
-message_cache_t::reshedule_message(const std::string& route, wuuid_t& uuid) {
-	boost::mutex::scoped_lock lock(m_mutex);
+void
+message_cache_t::add_hedged_message(const std::string& route, const cached_message_ptr_t& message) {
+	// copy has no ack timeout of its own, message is tracked by the original
+	m_sent_messages.insert(route, message);
+}
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+size_t
+message_cache_t::sent_copies_count(const wuuid_t& uuid) const {
+	return m_sent_messages.count(uuid);
+}
 
-	if (it == m_sent_messages.end()) {
-		return false;
-	}
+bool
+message_cache_t::reshedule_message(const std::string& route, wuuid_t& uuid) {
+	fetch_incoming();
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid.as_string());
+	boost::shared_ptr<message_iface> msg;
 
-	if (mit == msg_map.end()) {
+	if (!m_sent_messages.find(uuid, route, msg)) {
 		return false;
 	}
 
-	boost::shared_ptr<message_iface> msg = mit->second;
-
 	if (!msg) {
 		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
 	}
 
 	if (msg->can_retry()) {
 		msg->increment_retries_count();
-		msg_map.erase(mit);
+		m_sent_messages.remove(uuid, route, msg);
 
-		msg->mark_as_sent(false);
-		msg->set_ack_received(false);
-
-		m_new_messages->push_front(msg);
+		schedule_retry(msg, route);
 
 		return true;
 	}
@@ -195,30 +387,44 @@ message_cache_t::reshedule_message(const std::string& route, wuuid_t& uuid) {
 }
 
 void
-message_cache_t::move_sent_message_to_new(const std::string& route, wuuid_t& uuid) {
-	boost::mutex::scoped_lock lock(m_mutex);
+message_cache_t::schedule_retry(const cached_message_ptr_t& message, const std::string& failed_route) {
+	fetch_incoming();
+
+	message->mark_as_sent(false);
+	message->set_ack_received(false);
+	message->add_failed_route(failed_route);
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
+	double delay = retry_backoff(message);
 
-	if (it == m_sent_messages.end()) {
+	if (delay <= 0.0) {
+		m_new_messages->push_front(message);
 		return;
 	}
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid.as_string());
+	expiration_t expiration;
+	expiration.time = time_value::get_current_time().as_double() + delay;
+	expiration.type = RETRY_EXPIRATION;
+	expiration.sent_time = 0.0;
+	expiration.message = message;
+
+	push_expiration(expiration);
+	m_retry_messages.insert(message);
+}
+
+void
+message_cache_t::move_sent_message_to_new(const std::string& route, wuuid_t& uuid) {
+	fetch_incoming();
 
-	if (mit == msg_map.end()) {
+	boost::shared_ptr<message_iface> msg;
+
+	if (!m_sent_messages.remove(uuid, route, msg)) {
 		return;
 	}
 
-	boost::shared_ptr<message_iface> msg = mit->second;
-
 	if (!msg) {
 		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
 	}
 
-	msg_map.erase(mit);
-
 	msg->mark_as_sent(false);
 	msg->set_ack_received(false);
 
@@ -227,168 +433,186 @@ message_cache_t::move_sent_message_to_new(const std::string& route, wuuid_t& uui
 
 void
 message_cache_t::move_sent_message_to_new_front(const std::string& route, wuuid_t& uuid) {
-	boost::mutex::scoped_lock lock(m_mutex);
-
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-
-	if (it == m_sent_messages.end()) {
-		return;
-	}
+	fetch_incoming();
 
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid.as_string());
+	boost::shared_ptr<message_iface> msg;
 
-	if (mit == msg_map.end()) {
+	if (!m_sent_messages.remove(uuid, route, msg)) {
 		return;
 	}
 
-	boost::shared_ptr<message_iface> msg = mit->second;
-
 	if (!msg) {
 		throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
 	}
 
-	msg_map.erase(mit);
 	m_new_messages->push_front(msg);
 }
 
 void
 message_cache_t::remove_message_from_cache(const std::string& route, wuuid_t& uuid) {
-	boost::mutex::scoped_lock lock(m_mutex);
-
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-
-	if (it == m_sent_messages.end()) {
-		return;
-	}
-
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.find(uuid.as_string());
+	boost::shared_ptr<message_iface> msg;
 
-	if (mit == msg_map.end()) {
+	if (!m_sent_messages.find(uuid, route, msg)) {
 		return;
 	}
 
-	msg_map.erase(mit);
+	// message is finished, hedged copies on other routes go away too
+	remove_sent_message(msg);
+}
 
-	// check whether route is empty, erase if it is
-	if (msg_map.empty()) {
-		m_sent_messages.erase(it);
-	}
+void
+message_cache_t::remove_message_copy(const std::string& route, wuuid_t& uuid) {
+	boost::shared_ptr<message_iface> msg;
+	m_sent_messages.remove(uuid, route, msg);
 }
 
 void
 message_cache_t::make_all_messages_new() {
-	boost::mutex::scoped_lock lock(m_mutex);
+	fetch_incoming();
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
+	sent_messages_index_t::messages_list_t messages;
+	m_sent_messages.remove_all(messages);
 
-		sent_messages_map_t& msg_map = it->second;
-		sent_messages_map_t::iterator mit = msg_map.begin();
+	// hedged messages come once per route
+	std::set<message_iface*> requeued;
 
-		for (; mit != msg_map.end(); ++mit) {
-
-			if (!mit->second) {
-				throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
-			}
+	for (size_t i = 0; i < messages.size(); ++i) {
+		if (!messages[i]) {
+			throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
+		}
 
-			mit->second->mark_as_sent(false);
-			mit->second->set_ack_received(false);
-			m_new_messages->push_front(mit->second);
+		if (requeued.insert(messages[i].get()).second) {
+			m_new_messages->push_front(messages[i]);
 		}
+	}
 
-		msg_map.clear();
+	// messages waiting out retry backoff are sent before others anyway,
+	// their heap entries are recognized as stale later
+	std::set<cached_message_ptr_t>::iterator it = m_retry_messages.begin();
+	for (; it != m_retry_messages.end(); ++it) {
+		if (!(*it)->is_deadlined()) {
+			m_new_messages->push_front(*it);
+		}
 	}
 
-	for (message_queue_t::iterator it = m_new_messages->begin(); it != m_new_messages->end(); ++it) {
-		(*it)->mark_as_sent(false);
-		(*it)->set_ack_received(false);
+	m_retry_messages.clear();
+
+	for (message_queue_t::iterator qit = m_new_messages->begin(); qit != m_new_messages->end(); ++qit) {
+		(*qit)->mark_as_sent(false);
+		(*qit)->set_ack_received(false);
 	}
 }
 
 void
 message_cache_t::make_all_messages_new_for_route(const std::string& route) {
-	boost::mutex::scoped_lock lock(m_mutex);
+	fetch_incoming();
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.find(route);
-	if (it == m_sent_messages.end()) {
-		return;
-	}
-
-	sent_messages_map_t& msg_map = it->second;
-	sent_messages_map_t::iterator mit = msg_map.begin();
+	sent_messages_index_t::messages_list_t messages;
+	m_sent_messages.remove_route(route, messages);
 
-	if (msg_map.empty()) {
-		return;
-	}
-	
-	for (; mit != msg_map.end(); ++mit) {
-		if (!mit->second) {
+	for (size_t i = 0; i < messages.size(); ++i) {
+		if (!messages[i]) {
 			throw internal_error("empty cached message object at " + std::string(BOOST_CURRENT_FUNCTION));
 		}
 
-		mit->second->mark_as_sent(false);
-		mit->second->set_ack_received(false);
-		m_new_messages->push_front(mit->second);
-	}
+		// hedged message is still tracked on another route
+		if (m_sent_messages.count(messages[i]->uuid()) > 0) {
+			continue;
+		}
 
-	msg_map.clear();
+		messages[i]->mark_as_sent(false);
+		messages[i]->set_ack_received(false);
+		m_new_messages->push_front(messages[i]);
+	}
 }
 
 bool
-message_cache_t::is_message_expired(cached_message_ptr_t msg) {
-	return msg->is_expired();
+message_cache_t::remove_sent_message(const cached_message_ptr_t& message) {
+	// same uuid might have been reused by another message, so entries
+	// are matched by message object, hedged copies go away too
+	return m_sent_messages.remove_message(message);
 }
 
 void
-message_cache_t::get_expired_messages(message_queue_t& expired_messages) {
-	boost::mutex::scoped_lock lock(m_mutex);
+message_cache_t::get_expired_messages(message_queue_t& expired_messages,
+									  message_queue_t& hedge_messages)
+{
+	fetch_incoming();
+
+	double curr_time = time_value::get_current_time().as_double();
 
-	assert(m_new_messages);
+	while (!m_expirations.empty() && m_expirations.front().time <= curr_time) {
+		expiration_t expiration = m_expirations.front();
+		pop_expiration();
 
-	// remove expired from sent
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
+		// message is gone already
+		boost::shared_ptr<message_iface> msg = expiration.message.lock();
 
-		sent_messages_map_t& msg_map = it->second;
-		sent_messages_map_t::iterator mit = msg_map.begin();
+		// backoff passed, message is sent before others unless
+		// it was deadlined while waiting
+		if (expiration.type == RETRY_EXPIRATION) {
+			if (msg && m_retry_messages.erase(msg) > 0 && !msg->is_deadlined()) {
+				m_new_messages->push_front(msg);
+			}
 
-		while (mit != msg_map.end()) {
-			// get single sent message
-			boost::shared_ptr<message_iface> msg = mit->second;
-			assert(msg);
+			continue;
+		}
 
-			// remove expired messages
-			if (msg->is_expired()) {
-				expired_messages.push_back(msg);
-				msg_map.erase(mit++);
+		if (!msg || msg->is_deadlined()) {
+			continue;
+		}
+
+		// still unanswered and not hedged yet, see if it's time for a copy
+		if (expiration.type == HEDGE_EXPIRATION) {
+			boost::shared_ptr<message_iface> sent_msg;
+
+			if (msg->is_sent() &&
+				msg->sent_timestamp().as_double() == expiration.sent_time &&
+				m_sent_messages.count(msg->uuid()) == 1 &&
+				m_sent_messages.find(msg->uuid(), msg->destination_route(), sent_msg) &&
+				sent_msg == msg)
+			{
+				hedge_messages.push_back(msg);
 			}
-			else {
-				++mit;
+
+			continue;
+		}
+
+		// message was acked, resent or returned to new messages since
+		if (expiration.type == ACK_EXPIRATION) {
+			if (!msg->is_sent() ||
+				msg->ack_received() ||
+				msg->sent_timestamp().as_double() != expiration.sent_time)
+			{
+				continue;
 			}
 		}
-	}
 
-	// remove expired from new
-	message_queue_t::iterator it2 = m_new_messages->begin();
-	while (it2 != m_new_messages->end()) {
-		// get single pending message
-		boost::shared_ptr<message_iface> msg = *it2;
-		assert(msg);
+		// timer fired a little early, check again when it's really due
+		if (!msg->is_expired()) {
+			if (expiration.type == ACK_EXPIRATION) {
+				expiration.time = expiration.sent_time + msg->policy().ack_timeout;
+			}
+			else {
+				expiration.time = msg->enqued_timestamp().as_double() + msg->policy().deadline;
+			}
+
+			// clocks of message and heap may differ by rounding
+			expiration.time = std::max(expiration.time, curr_time + 0.001);
+			push_expiration(expiration);
+			continue;
+		}
 
-		// remove expired messages
-		if (msg->is_expired()) {
-			expired_messages.push_back(msg);
+		// sent message that is not in cache anymore (already responded)
+		if (msg->is_sent() && !remove_sent_message(msg)) {
+			continue;
 		}
 
-		++it2;
+		// deadlined new messages are dropped from queue lazily
+		expired_messages.push_back(msg);
 	}
 
-	m_new_messages->erase(std::remove_if(m_new_messages->begin(),
-										 m_new_messages->end(),
-										 &message_cache_t::is_message_expired),
-										 m_new_messages->end());
+	drop_deadlined_new_messages();
 }
 
 void
@@ -399,10 +623,12 @@ message_cache_t::log_stats() {
 
 	log(PLOG_DEBUG, "new messages: %d", m_new_messages->size());
 
-	route_sent_messages_map_t::iterator it = m_sent_messages.begin();
-	for (; it != m_sent_messages.end(); ++it) {
-		sent_messages_map_t& msg_map = it->second;
-		log(PLOG_DEBUG, "sent messages for route: %s, size: %d", it->first.c_str(), msg_map.size());
+	std::map<std::string, size_t> routes_sizes;
+	m_sent_messages.routes_sizes(routes_sizes);
+
+	std::map<std::string, size_t>::iterator it = routes_sizes.begin();
+	for (; it != routes_sizes.end(); ++it) {
+		log(PLOG_DEBUG, "sent messages for route: %s, size: %d", it->first.c_str(), it->second);
 	}
 }
 
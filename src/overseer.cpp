@@ -406,7 +406,7 @@ overseer_t::endpoints_set_equal(const endpoints_set_t& lhs, const endpoints_set_
 	for (; it != lhs.end(); ++it) {
 		endpoints_set_t::iterator it2 = rhs.find(*it);
 
-		if (it2 == rhs.end() || it->weight != it2->weight) {
+		if (it2 == rhs.end() || it->weight != it2->weight || it->window != it2->window) {
 			return false;
 		}
 	}
@@ -414,6 +414,50 @@ overseer_t::endpoints_set_equal(const endpoints_set_t& lhs, const endpoints_set_
 	return true;
 }
 
+double
+overseer_t::endpoint_weight(const service_info_t& service_info,
+							const std::string& node_identity,
+							const cocaine_node_app_info_t& app) const
+{
+	double capacity = 1.0;
+
+	std::map<std::string, double>::const_iterator it = service_info.node_weights.find(node_identity);
+	if (it != service_info.node_weights.end()) {
+		capacity = it->second;
+	}
+	else if (app.slaves_total > 0) {
+		capacity = app.slaves_total;
+	}
+
+	if (app.slaves_total == 0) {
+		return capacity;
+	}
+
+	unsigned int free_slaves = 0;
+	if (app.slaves_total > app.slaves_busy) {
+		free_slaves = app.slaves_total - app.slaves_busy;
+	}
+
+	// queued and pending work counts against capacity too
+	double load_capacity = app.slaves_total + app.queue_depth + app.sessions_pending;
+	double idle_share = free_slaves / load_capacity;
+
+	// few levels only, so that small load changes don't cause handle updates
+	int load_level = 1 + static_cast<int>(idle_share * (load_levels - 1) + 0.5);
+	return capacity * load_level / load_levels;
+}
+
+size_t
+overseer_t::endpoint_window(const service_info_t& service_info,
+							const cocaine_node_app_info_t& app) const
+{
+	if (service_info.endpoint_window >= 0) {
+		return static_cast<size_t>(service_info.endpoint_window);
+	}
+
+	return app.slaves_total * defaults_t::endpoint_window_per_slave;
+}
+
 void
 overseer_t::routing_table_from_responces(const std::map<std::string, cocaine_node_list_t>& parsed_responses,
 										 routing_table_t& routing_table)
@@ -427,10 +471,12 @@ overseer_t::routing_table_from_responces(const std::map<std::string, cocaine_nod
 		std::string			app_name;
 		handle_endpoints_t	handle_endpoints;
 
+		std::map<std::string, service_info_t>::const_iterator its;
+
 		{
 			// get app name from service info
 			service_name = it->first;
-			std::map<std::string, service_info_t>::const_iterator its = services_list.find(service_name);
+			its = services_list.find(service_name);
 
 			if (its == services_list.end()) {
 				continue;
@@ -457,7 +503,7 @@ overseer_t::routing_table_from_responces(const std::map<std::string, cocaine_nod
 				continue;
 			}
 
-			int weight = 0;
+			double weight = 0.0;
 
 			// verify app status
 			switch (app.status) {
@@ -467,11 +513,11 @@ overseer_t::routing_table_from_responces(const std::map<std::string, cocaine_nod
 					break;
 
 				case APP_STATUS_RUNNING:
-					weight = 1;
+					weight = endpoint_weight(its->second, service_node_list[i].identity, app);
 					break;
 
 				case APP_STATUS_STOPPING:
-					weight = 0;
+					weight = 0.0;
 					break;
 
 				case APP_STATUS_STOPPED:
@@ -498,7 +544,8 @@ overseer_t::routing_table_from_responces(const std::map<std::string, cocaine_nod
 				// create endpoint
 				cocaine_endpoint_t endpoint(task_it->second.endpoint,
 											task_it->second.identity,
-											weight);
+											weight,
+											endpoint_window(its->second, app));
 
 				// find specific service->handle routing table:
 				// first, find service
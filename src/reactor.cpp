@@ -0,0 +1,230 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/functional/hash.hpp>
+#include <boost/current_function.hpp>
+
+#include "cocaine/dealer/core/reactor.hpp"
+#include "cocaine/dealer/utils/error.hpp"
+#include "cocaine/dealer/utils/threading.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+namespace {
+	// runs task and signals the waiting thread once it's done
+	struct sync_task_t {
+		sync_task_t(const reactor_worker_t::task_t& task) :
+			m_task(task),
+			m_done(false) {}
+
+		void operator() () {
+			try {
+				m_task();
+			}
+			catch (const std::exception& ex) {
+				m_error = ex.what();
+			}
+			catch (...) {
+				m_error = "unknown error";
+			}
+
+			boost::mutex::scoped_lock lock(m_mutex);
+			m_done = true;
+			m_cond_var.notify_one();
+		}
+
+		void wait() {
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			while (!m_done) {
+				m_cond_var.wait(lock);
+			}
+		}
+
+		reactor_worker_t::task_t	m_task;
+		std::string					m_error;
+		bool						m_done;
+		boost::mutex				m_mutex;
+		boost::condition_variable	m_cond_var;
+	};
+}
+
+reactor_worker_t::reactor_worker_t(size_t index,
+								   const std::vector<int>& cpus,
+								   const boost::shared_ptr<base_logger_t>& logger) :
+	m_index(index),
+	m_cpus(cpus),
+	m_logger(logger)
+{
+	m_event_loop.reset(new ev::dynamic_loop);
+
+	m_tasks_watcher.reset(new ev::async(*m_event_loop));
+	m_tasks_watcher->set<reactor_worker_t, &reactor_worker_t::process_tasks>(this);
+	m_tasks_watcher->start();
+
+	m_thread = boost::thread(&reactor_worker_t::run, this);
+}
+
+reactor_worker_t::~reactor_worker_t() {
+	post(boost::bind(&reactor_worker_t::terminate, this));
+	m_thread.join();
+}
+
+ev::dynamic_loop&
+reactor_worker_t::loop() {
+	return *m_event_loop;
+}
+
+bool
+reactor_worker_t::in_worker_thread() const {
+	return boost::this_thread::get_id() == m_thread.get_id();
+}
+
+size_t
+reactor_worker_t::index() const {
+	return m_index;
+}
+
+void
+reactor_worker_t::post(const task_t& task) {
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		m_tasks.push_back(task);
+	}
+
+	m_tasks_watcher->send();
+}
+
+void
+reactor_worker_t::execute(const task_t& task) {
+	// called from inside the loop — no need to wait
+	if (in_worker_thread()) {
+		task();
+		return;
+	}
+
+	sync_task_t sync_task(task);
+	post(boost::bind(&sync_task_t::operator(), &sync_task));
+	sync_task.wait();
+
+	if (!sync_task.m_error.empty()) {
+		std::string error_msg = "reactor task failed at " + std::string(BOOST_CURRENT_FUNCTION);
+		error_msg += ", details: " + sync_task.m_error;
+		throw internal_error(error_msg);
+	}
+}
+
+void
+reactor_worker_t::run() {
+	if (!tutils::set_current_thread_affinity(m_cpus) && m_logger) {
+		m_logger->log(PLOG_WARNING, "could not pin dispatch thread %d to requested cpus", (int)m_index);
+	}
+
+	m_event_loop->loop();
+}
+
+void
+reactor_worker_t::process_tasks(ev::async& watcher, int type) {
+	std::deque<task_t> tasks;
+
+	{
+		boost::mutex::scoped_lock lock(m_mutex);
+		tasks.swap(m_tasks);
+	}
+
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		run_task(tasks[i]);
+	}
+}
+
+void
+reactor_worker_t::run_task(const task_t& task) {
+	try {
+		task();
+	}
+	catch (const std::exception& ex) {
+		if (m_logger) {
+			m_logger->log(PLOG_ERROR, "reactor task failed, details: %s", ex.what());
+		}
+	}
+	catch (...) {
+		if (m_logger) {
+			m_logger->log(PLOG_ERROR, "reactor task failed, details: unknown error");
+		}
+	}
+}
+
+void
+reactor_worker_t::terminate() {
+	m_tasks_watcher->stop();
+	m_event_loop->unloop(ev::ALL);
+}
+
+reactor_t::reactor_t(size_t workers_count,
+					 const std::vector<int>& cpus,
+					 const boost::shared_ptr<base_logger_t>& logger) :
+	m_next_worker_index(0)
+{
+	if (workers_count == 0) {
+		workers_count = 1;
+	}
+
+	for (size_t i = 0; i < workers_count; ++i) {
+		std::vector<int> worker_cpus;
+
+		if (!cpus.empty()) {
+			worker_cpus.push_back(cpus[i % cpus.size()]);
+		}
+
+		m_workers.push_back(worker_ptr_t(new reactor_worker_t(i, worker_cpus, logger)));
+	}
+}
+
+reactor_t::~reactor_t() {
+	m_workers.clear();
+}
+
+reactor_t::worker_ptr_t
+reactor_t::next_worker() {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	worker_ptr_t worker = m_workers[m_next_worker_index];
+	m_next_worker_index = (m_next_worker_index + 1) % m_workers.size();
+
+	return worker;
+}
+
+reactor_t::worker_ptr_t
+reactor_t::worker_for(const std::string& key) {
+	boost::hash<std::string> hasher;
+	return m_workers[hasher(key) % m_workers.size()];
+}
+
+size_t
+reactor_t::workers_count() const {
+	return m_workers.size();
+}
+
+} // namespace dealer
+} // namespace cocaine
@@ -26,8 +26,11 @@
 namespace cocaine {
 namespace dealer {
 
-response_t::response_t(const wuuid_t& uuid, const message_path_t& path) {
-	m_impl.reset(new response_impl_t(uuid, path));
+response_t::response_t(const wuuid_t& uuid,
+					   const message_path_t& path,
+					   const response_handler_t& handler)
+{
+	m_impl.reset(new response_impl_t(uuid, path, handler));
 }
 
 response_t::~response_t() {
@@ -44,5 +47,20 @@ response_t::add_chunk(const boost::shared_ptr<response_chunk_t>& chunk) {
 	m_impl->add_chunk(chunk);
 }
 
+bool
+response_t::has_handler() const {
+	return !m_impl->m_handler.empty();
+}
+
+bool
+response_t::is_finished() {
+	return m_impl->is_finished();
+}
+
+bool
+response_t::claim_route(const std::string& route) {
+	return m_impl->claim_route(route);
+}
+
 } // namespace dealer
 } // namespace cocaine
@@ -32,11 +32,15 @@
 namespace cocaine {
 namespace dealer {
 
-response_impl_t::response_impl_t(const wuuid_t& uuid, const message_path_t& path) :
+response_impl_t::response_impl_t(const wuuid_t& uuid,
+								 const message_path_t& path,
+								 const response_handler_t& handler) :
 	m_uuid(uuid),
 	m_path(path),
 	m_response_finished(false),
-	m_message_finished(false)
+	m_message_finished(false),
+	m_handler(handler),
+	m_callbacks_running(false)
 {}
 
 response_impl_t::~response_impl_t() {
@@ -48,6 +52,11 @@ response_impl_t::~response_impl_t() {
 
 bool
 response_impl_t::get(data_container* data, double timeout) {
+	// chunks never get here, waiting for them would block forever
+	if (!m_handler.empty()) {
+		throw internal_error("get() called for response with handler, chunks are passed to the handler");
+	}
+
 	boost::mutex::scoped_lock lock(m_mutex);
 
 	// we're all done (error or choke received)
@@ -100,6 +109,35 @@ response_impl_t::add_chunk(const boost::shared_ptr<response_chunk_t>& chunk) {
 		return;
 	}
 
+	// pass chunk to handler instead of storing it
+	if (!m_handler.empty()) {
+		response_handler_t::task_t callback;
+
+		switch (chunk->rpc_code) {
+			case SERVER_RPC_MESSAGE_CHUNK:
+				callback = boost::bind(&response_impl_t::invoke_chunk, shared_from_this(), chunk);
+				break;
+
+			case SERVER_RPC_MESSAGE_CHOKE:
+				callback = boost::bind(&response_impl_t::invoke_complete, shared_from_this());
+				m_message_finished = true;
+				break;
+
+			case SERVER_RPC_MESSAGE_ERROR:
+				callback = boost::bind(&response_impl_t::invoke_error, shared_from_this(), chunk);
+				m_message_finished = true;
+				break;
+
+			default:
+				throw internal_error("response_t received chunk with invalid RPC code: %d", chunk->rpc_code);
+				break;
+		}
+
+		lock.unlock();
+		schedule_callback(callback);
+		return;
+	}
+
 	switch (chunk->rpc_code) {
 		case SERVER_RPC_MESSAGE_CHUNK:
 			m_chunks.push_back(chunk);
@@ -125,5 +163,94 @@ response_impl_t::add_chunk(const boost::shared_ptr<response_chunk_t>& chunk) {
 	m_cond_var.notify_one();
 }
 
+bool
+response_impl_t::is_finished() {
+	boost::mutex::scoped_lock lock(m_mutex);
+	return m_message_finished;
+}
+
+bool
+response_impl_t::claim_route(const std::string& route) {
+	boost::mutex::scoped_lock lock(m_mutex);
+
+	if (route.empty()) {
+		return true;
+	}
+
+	if (m_route.empty()) {
+		m_route = route;
+	}
+
+	return m_route == route;
+}
+
+void
+response_impl_t::schedule_callback(const response_handler_t::task_t& callback) {
+	boost::mutex::scoped_lock lock(m_mutex);
+	m_callbacks.push_back(callback);
+
+	// someone is already running callbacks, it will pick this one too
+	if (m_callbacks_running) {
+		return;
+	}
+
+	m_callbacks_running = true;
+	lock.unlock();
+
+	if (m_handler.executor.empty()) {
+		run_callbacks();
+	}
+	else {
+		m_handler.executor(boost::bind(&response_impl_t::run_callbacks, shared_from_this()));
+	}
+}
+
+void
+response_impl_t::run_callbacks() {
+	while (true) {
+		response_handler_t::task_t callback;
+
+		{
+			boost::mutex::scoped_lock lock(m_mutex);
+
+			if (m_callbacks.empty()) {
+				m_callbacks_running = false;
+				return;
+			}
+
+			callback = m_callbacks.front();
+			m_callbacks.pop_front();
+		}
+
+		// exceptions of user code must not get into dealer threads
+		try {
+			callback();
+		}
+		catch (...) {
+		}
+	}
+}
+
+void
+response_impl_t::invoke_chunk(const boost::shared_ptr<response_chunk_t>& chunk) {
+	if (m_handler.on_chunk) {
+		m_handler.on_chunk(chunk->data);
+	}
+}
+
+void
+response_impl_t::invoke_error(const boost::shared_ptr<response_chunk_t>& chunk) {
+	if (m_handler.on_error) {
+		m_handler.on_error(chunk->error_code, chunk->error_message);
+	}
+}
+
+void
+response_impl_t::invoke_complete() {
+	if (m_handler.on_complete) {
+		m_handler.on_complete();
+	}
+}
+
 } // namespace dealer
 } // namespace cocaine
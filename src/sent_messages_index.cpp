@@ -0,0 +1,416 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#include <cassert>
+#include <cstring>
+
+#include "cocaine/dealer/core/sent_messages_index.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+sent_messages_index_t::sent_messages_index_t() :
+	m_size(0)
+{
+	slot_t empty_slot = { 0, 0 };
+	m_slots.resize(initial_capacity, empty_slot);
+}
+
+sent_messages_index_t::~sent_messages_index_t() {
+}
+
+boost::uint32_t
+sent_messages_index_t::hash(const unsigned char* uuid) {
+	boost::uint64_t lo;
+	boost::uint64_t hi;
+
+	memcpy(&lo, uuid, sizeof(lo));
+	memcpy(&hi, uuid + sizeof(lo), sizeof(hi));
+
+	boost::uint64_t h = (lo ^ hi) * 0x9e3779b97f4a7c15ULL;
+	return static_cast<boost::uint32_t>(h >> 32);
+}
+
+bool
+sent_messages_index_t::find_slot(const unsigned char* uuid,
+								 boost::uint32_t route,
+								 boost::uint32_t hash,
+								 size_t& slot) const
+{
+	size_t mask = m_slots.size() - 1;
+	size_t i = hash & mask;
+
+	// table is never full, so there's always an empty slot to stop at
+	while (m_slots[i].entry != 0) {
+		if (m_slots[i].hash == hash) {
+			const entry_t& entry = m_entries[m_slots[i].entry - 1];
+
+			if (entry.route == route && memcmp(entry.uuid, uuid, wuuid_t::UUID_SIZE) == 0) {
+				slot = i;
+				return true;
+			}
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	slot = i;
+	return false;
+}
+
+bool
+sent_messages_index_t::find_slot(const unsigned char* uuid,
+								 const std::string& route,
+								 boost::uint32_t hash,
+								 size_t& slot) const
+{
+	size_t mask = m_slots.size() - 1;
+	size_t i = hash & mask;
+
+	// uuid mismatch is ruled out first, route name is compared
+	// only for entries of the same message
+	while (m_slots[i].entry != 0) {
+		if (m_slots[i].hash == hash) {
+			const entry_t& entry = m_entries[m_slots[i].entry - 1];
+
+			if (memcmp(entry.uuid, uuid, wuuid_t::UUID_SIZE) == 0 &&
+				m_routes[entry.route].name == route)
+			{
+				slot = i;
+				return true;
+			}
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	return false;
+}
+
+void
+sent_messages_index_t::insert_slot(boost::uint32_t entry, boost::uint32_t hash) {
+	size_t mask = m_slots.size() - 1;
+	size_t i = hash & mask;
+
+	while (m_slots[i].entry != 0) {
+		i = (i + 1) & mask;
+	}
+
+	m_slots[i].entry = entry + 1;
+	m_slots[i].hash = hash;
+}
+
+void
+sent_messages_index_t::erase_slot(size_t slot) {
+	size_t mask = m_slots.size() - 1;
+	size_t hole = slot;
+	size_t i = slot;
+
+	// shift following entries back into the hole, no tombstones
+	while (true) {
+		i = (i + 1) & mask;
+
+		if (m_slots[i].entry == 0) {
+			break;
+		}
+
+		size_t home = m_slots[i].hash & mask;
+
+		// entry can be moved only if its home slot is not within (hole, i]
+		bool movable = (hole <= i) ? (home <= hole || home > i) : (home <= hole && home > i);
+
+		if (movable) {
+			m_slots[hole] = m_slots[i];
+			hole = i;
+		}
+	}
+
+	m_slots[hole].entry = 0;
+	m_slots[hole].hash = 0;
+}
+
+void
+sent_messages_index_t::grow() {
+	std::vector<slot_t> old_slots;
+	old_slots.swap(m_slots);
+
+	slot_t empty_slot = { 0, 0 };
+	m_slots.resize(old_slots.size() * 2, empty_slot);
+
+	for (size_t i = 0; i < old_slots.size(); ++i) {
+		if (old_slots[i].entry != 0) {
+			insert_slot(old_slots[i].entry - 1, old_slots[i].hash);
+		}
+	}
+}
+
+boost::uint32_t
+sent_messages_index_t::allocate_entry() {
+	if (!m_free_entries.empty()) {
+		boost::uint32_t entry = m_free_entries.back();
+		m_free_entries.pop_back();
+		return entry;
+	}
+
+	m_entries.push_back(entry_t());
+	return static_cast<boost::uint32_t>(m_entries.size() - 1);
+}
+
+void
+sent_messages_index_t::release_entry(boost::uint32_t entry) {
+	entry_t& e = m_entries[entry];
+	route_t& r = m_routes[e.route];
+
+	// unlink from route list
+	if (e.prev != nil) {
+		m_entries[e.prev].next = e.next;
+	}
+	else {
+		r.head = e.next;
+	}
+
+	if (e.next != nil) {
+		m_entries[e.next].prev = e.prev;
+	}
+
+	// drop route once it has no messages
+	if (--r.size == 0) {
+		m_routes_ids.erase(r.name);
+		r.name.clear();
+		m_free_routes.push_back(e.route);
+	}
+
+	e.message.reset();
+	m_free_entries.push_back(entry);
+	--m_size;
+}
+
+boost::uint32_t
+sent_messages_index_t::route_id(const std::string& route) {
+	std::map<std::string, boost::uint32_t>::iterator it = m_routes_ids.find(route);
+
+	if (it != m_routes_ids.end()) {
+		return it->second;
+	}
+
+	boost::uint32_t id;
+
+	if (!m_free_routes.empty()) {
+		id = m_free_routes.back();
+		m_free_routes.pop_back();
+	}
+	else {
+		m_routes.push_back(route_t());
+		id = static_cast<boost::uint32_t>(m_routes.size() - 1);
+	}
+
+	m_routes[id].name = route;
+	m_routes[id].head = nil;
+	m_routes[id].size = 0;
+	m_routes_ids[route] = id;
+
+	return id;
+}
+
+void
+sent_messages_index_t::insert(const std::string& route, const message_ptr_t& message) {
+	const unsigned char* uuid = message->uuid().data();
+	boost::uint32_t h = hash(uuid);
+	boost::uint32_t rid = route_id(route);
+
+	// resent to the same route, replace
+	size_t slot;
+	if (find_slot(uuid, rid, h, slot)) {
+		m_entries[m_slots[slot].entry - 1].message = message;
+		return;
+	}
+
+	if ((m_size + 1) * 4 > m_slots.size() * 3) {
+		grow();
+	}
+
+	boost::uint32_t entry = allocate_entry();
+
+	entry_t& e = m_entries[entry];
+	memcpy(e.uuid, uuid, wuuid_t::UUID_SIZE);
+	e.message = message;
+	e.route = rid;
+
+	// link to route list
+	route_t& r = m_routes[rid];
+	e.prev = nil;
+	e.next = r.head;
+
+	if (r.head != nil) {
+		m_entries[r.head].prev = entry;
+	}
+
+	r.head = entry;
+	++r.size;
+
+	insert_slot(entry, h);
+	++m_size;
+}
+
+bool
+sent_messages_index_t::find(const wuuid_t& uuid, const std::string& route, message_ptr_t& message) const {
+	size_t slot;
+	if (!find_slot(uuid.data(), route, hash(uuid.data()), slot)) {
+		return false;
+	}
+
+	message = m_entries[m_slots[slot].entry - 1].message;
+	return true;
+}
+
+bool
+sent_messages_index_t::remove(const wuuid_t& uuid, const std::string& route, message_ptr_t& message) {
+	size_t slot;
+	if (!find_slot(uuid.data(), route, hash(uuid.data()), slot)) {
+		return false;
+	}
+
+	boost::uint32_t entry = m_slots[slot].entry - 1;
+	message = m_entries[entry].message;
+
+	release_entry(entry);
+	erase_slot(slot);
+
+	return true;
+}
+
+size_t
+sent_messages_index_t::count(const wuuid_t& uuid) const {
+	boost::uint32_t h = hash(uuid.data());
+	size_t mask = m_slots.size() - 1;
+	size_t count = 0;
+
+	// all entries of uuid share the probe sequence
+	for (size_t i = h & mask; m_slots[i].entry != 0; i = (i + 1) & mask) {
+		if (m_slots[i].hash != h) {
+			continue;
+		}
+
+		const entry_t& entry = m_entries[m_slots[i].entry - 1];
+
+		if (memcmp(entry.uuid, uuid.data(), wuuid_t::UUID_SIZE) == 0) {
+			++count;
+		}
+	}
+
+	return count;
+}
+
+bool
+sent_messages_index_t::remove_message(const message_ptr_t& message) {
+	const unsigned char* uuid = message->uuid().data();
+	boost::uint32_t h = hash(uuid);
+	size_t mask = m_slots.size() - 1;
+	bool removed = false;
+
+	// erasing shifts following slots back, so rescan from the start
+	size_t i = h & mask;
+	while (m_slots[i].entry != 0) {
+		boost::uint32_t entry = m_slots[i].entry - 1;
+
+		if (m_slots[i].hash == h &&
+			m_entries[entry].message == message &&
+			memcmp(m_entries[entry].uuid, uuid, wuuid_t::UUID_SIZE) == 0)
+		{
+			release_entry(entry);
+			erase_slot(i);
+			removed = true;
+
+			i = h & mask;
+			continue;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	return removed;
+}
+
+void
+sent_messages_index_t::remove_route(const std::string& route, messages_list_t& messages) {
+	std::map<std::string, boost::uint32_t>::iterator it = m_routes_ids.find(route);
+
+	if (it == m_routes_ids.end()) {
+		return;
+	}
+
+	boost::uint32_t rid = it->second;
+
+	// route is released together with its last entry
+	while (m_routes[rid].size > 0) {
+		boost::uint32_t entry = m_routes[rid].head;
+		const unsigned char* uuid = m_entries[entry].uuid;
+
+		size_t slot;
+		bool found = find_slot(uuid, rid, hash(uuid), slot);
+		assert(found);
+
+		messages.push_back(m_entries[entry].message);
+
+		release_entry(entry);
+		erase_slot(slot);
+	}
+}
+
+void
+sent_messages_index_t::remove_all(messages_list_t& messages) {
+	std::vector<std::string> routes;
+
+	std::map<std::string, boost::uint32_t>::iterator it = m_routes_ids.begin();
+	for (; it != m_routes_ids.end(); ++it) {
+		routes.push_back(it->first);
+	}
+
+	for (size_t i = 0; i < routes.size(); ++i) {
+		remove_route(routes[i], messages);
+	}
+}
+
+size_t
+sent_messages_index_t::size() const {
+	return m_size;
+}
+
+size_t
+sent_messages_index_t::route_size(const std::string& route) const {
+	std::map<std::string, boost::uint32_t>::const_iterator it = m_routes_ids.find(route);
+
+	if (it == m_routes_ids.end()) {
+		return 0;
+	}
+
+	return m_routes[it->second].size;
+}
+
+void
+sent_messages_index_t::routes_sizes(std::map<std::string, size_t>& sizes) const {
+	std::map<std::string, boost::uint32_t>::const_iterator it = m_routes_ids.begin();
+	for (; it != m_routes_ids.end(); ++it) {
+		sizes[it->first] = m_routes[it->second].size;
+	}
+}
+
+} // namespace dealer
+} // namespace cocaine
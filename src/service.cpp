@@ -36,6 +36,12 @@ service_t::service_t(const service_info_t& info,
 
 	m_responces_cleanup_timer.reset();
 
+	if (m_info.concurrency_limited) {
+		m_limiter.reset(new concurrency_limiter_t(m_info.concurrency_initial,
+												  m_info.concurrency_min,
+												  m_info.concurrency_max));
+	}
+
 	// run timed out messages checker
 	m_deadlined_messages_refresher.reset(new refresher(boost::bind(&service_t::check_for_deadlined_messages, this),
 										 deadline_check_interval));
@@ -91,18 +97,30 @@ service_t::info() const {
 }
 
 boost::shared_ptr<response_t>
-service_t::send_message(cached_message_prt_t message) {
+service_t::send_message(cached_message_prt_t message, const response_handler_t& handler) {
+	response_handler_t response_handler(handler);
+
+	// callbacks must not run on dispatch thread that received the chunk,
+	// worker is not referenced by handler, as the last reference must not
+	// go away inside the worker itself, context outlives services anyway
+	if (!response_handler.empty() && response_handler.executor.empty()) {
+		reactor_worker_t* worker = context()->callbacks_worker().get();
+		response_handler.executor = boost::bind(&reactor_worker_t::post, worker, _1);
+	}
 
 	boost::shared_ptr<response_t> resp;
-	resp.reset(new response_t(message->uuid(), message->path()));
+	resp.reset(new response_t(message->uuid(), message->path(), response_handler));
 
 	{
 		boost::mutex::scoped_lock lock(m_responces_mutex);
 		m_responses[message->uuid().as_string()] = resp;
 	}
 
+	if (!admit_message(message)) {
+		return resp;
+	}
 
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 	bool enqued = enque_to_handle(message);
 
 	if (!enqued) {
@@ -112,11 +130,58 @@ service_t::send_message(cached_message_prt_t message) {
 	return resp;
 }
 
+std::vector<boost::shared_ptr<response_t> >
+service_t::send_messages(const cached_messages_deque_t& messages) {
+	std::vector<boost::shared_ptr<response_t> > responses;
+	responses.reserve(messages.size());
+
+	for (size_t i = 0; i < messages.size(); ++i) {
+		const cached_message_prt_t& message = messages[i];
+		responses.push_back(boost::shared_ptr<response_t>(new response_t(message->uuid(), message->path())));
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_responces_mutex);
+
+		for (size_t i = 0; i < messages.size(); ++i) {
+			m_responses[messages[i]->uuid().as_string()] = responses[i];
+		}
+	}
+
+	cached_messages_deque_t admitted;
+	admit_messages(messages, admitted);
+
+	// split batch by handles, so that every handle is woken up only once
+	std::map<std::string, messages_deque_ptr_t> handles_queues;
+
+	for (size_t i = 0; i < admitted.size(); ++i) {
+		messages_deque_ptr_t& queue = handles_queues[admitted[i]->path().handle_name];
+
+		if (!queue) {
+			queue.reset(new cached_messages_deque_t);
+		}
+
+		queue->push_back(admitted[i]);
+	}
+
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
+
+	std::map<std::string, messages_deque_ptr_t>::iterator it = handles_queues.begin();
+	for (; it != handles_queues.end(); ++it) {
+		if (!enque_to_handle(it->first, it->second)) {
+			append_to_unhandled(it->first, it->second);
+		}
+	}
+
+	return responses;
+}
+
 void
 service_t::enqueue_responce(boost::shared_ptr<response_chunk_t>& response) {
 	assert(response);
 
 	boost::shared_ptr<response_t> response_object;
+	bool abandoned = false;
 
 	{
 		boost::mutex::scoped_lock lock(m_responces_mutex);
@@ -128,7 +193,7 @@ service_t::enqueue_responce(boost::shared_ptr<response_chunk_t>& response) {
 			it = m_responses.begin();
 
 			while (it != m_responses.end()) {
-				if (it->second.unique()) {
+				if (it->second.unique() && (!it->second->has_handler() || it->second->is_finished())) {
 					m_responses.erase(it++);
 				}
 				else {
@@ -142,21 +207,180 @@ service_t::enqueue_responce(boost::shared_ptr<response_chunk_t>& response) {
 		// find response object for received chunk
 		it = m_responses.find(response->uuid.as_string());
 
-		// no response object -> discard chunk
-		if (it == m_responses.end()) {
-			return;
+		if (it != m_responses.end()) {
+			response_object = it->second;
+
+			// response object has only one ref and nobody waits for it
+			abandoned = (it->second.unique() && !it->second->has_handler());
+		}
+	}
+
+	// loser of hedged message, the winning copy still holds the limit
+	if (response_object && !response_object->claim_route(response->route)) {
+		return;
+	}
+
+	if (m_limiter.get() && response->rpc_code != SERVER_RPC_MESSAGE_CHUNK) {
+		release_message(response);
+	}
+
+	// no response object or nobody waits for it -> discard chunk
+	if (!response_object || abandoned) {
+		return;
+	}
+
+	response_object->add_chunk(response);
+
+	// handler got everything, service doesn't need to keep response anymore
+	if (response_object->has_handler() && response_object->is_finished()) {
+		boost::mutex::scoped_lock lock(m_responces_mutex);
+		m_responses.erase(response->uuid.as_string());
+	}
+}
+
+bool
+service_t::admit_message(const cached_message_prt_t& message) {
+	if (!m_limiter.get()) {
+		return true;
+	}
+
+	{
+		boost::mutex::scoped_lock lock(m_limiter_mutex);
+
+		// waiting messages go first
+		if (m_limiter_queue.empty() && m_limiter->try_acquire()) {
+			m_limited_messages[message->uuid().as_string()] = time_value::get_current_time().as_double();
+			return true;
 		}
 
-		// response object has only one ref -> discard chunk
-		if (it->second.unique()) {
+		if (m_info.concurrency_overflow == LO_QUEUE) {
+			m_limiter_queue.push_back(message);
+			return false;
+		}
+	}
+
+	reject_message(message);
+	return false;
+}
+
+void
+service_t::admit_messages(const cached_messages_deque_t& messages, cached_messages_deque_t& admitted) {
+	if (!m_limiter.get()) {
+		admitted.insert(admitted.end(), messages.begin(), messages.end());
+		return;
+	}
+
+	cached_messages_deque_t rejected;
+
+	{
+		boost::mutex::scoped_lock lock(m_limiter_mutex);
+		double curr_time = time_value::get_current_time().as_double();
+
+		for (size_t i = 0; i < messages.size(); ++i) {
+			const cached_message_prt_t& message = messages[i];
+
+			// waiting messages go first
+			if (m_limiter_queue.empty() && m_limiter->try_acquire()) {
+				m_limited_messages[message->uuid().as_string()] = curr_time;
+				admitted.push_back(message);
+			}
+			else if (m_info.concurrency_overflow == LO_QUEUE) {
+				m_limiter_queue.push_back(message);
+			}
+			else {
+				rejected.push_back(message);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < rejected.size(); ++i) {
+		reject_message(rejected[i]);
+	}
+}
+
+void
+service_t::reject_message(const cached_message_prt_t& message) {
+	boost::shared_ptr<response_chunk_t> response(new response_chunk_t);
+	response->uuid = message->uuid();
+	response->rpc_code = SERVER_RPC_MESSAGE_ERROR;
+	response->error_code = resource_error;
+	response->error_message = "service concurrency limit exceeded";
+	enqueue_responce(response);
+}
+
+void
+service_t::release_message(const boost::shared_ptr<response_chunk_t>& response) {
+	cached_messages_deque_t admitted;
+
+	{
+		boost::mutex::scoped_lock lock(m_limiter_mutex);
+
+		// hedged message is released by its first reply only
+		std::map<std::string, double>::iterator it = m_limited_messages.find(response->uuid.as_string());
+		if (it == m_limited_messages.end()) {
 			return;
 		}
 
-		response_object = it->second;
+		double latency = time_value::get_current_time().as_double() - it->second;
+		m_limited_messages.erase(it);
+
+		// overload signs, not failures of request itself
+		bool dropped = (response->rpc_code == SERVER_RPC_MESSAGE_ERROR &&
+						(response->error_code == deadline_error ||
+						 response->error_code == timeout_error ||
+						 response->error_code == resource_error));
+
+		m_limiter->release(latency, dropped);
+
+		while (!m_limiter_queue.empty() && m_limiter->try_acquire()) {
+			const cached_message_prt_t& message = m_limiter_queue.front();
+			m_limited_messages[message->uuid().as_string()] = time_value::get_current_time().as_double();
+
+			admitted.push_back(message);
+			m_limiter_queue.pop_front();
+		}
 	}
 
-	assert(response_object);
-	response_object->add_chunk(response);
+	if (admitted.empty()) {
+		return;
+	}
+
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
+
+	for (size_t i = 0; i < admitted.size(); ++i) {
+		if (!enque_to_handle(admitted[i])) {
+			enque_to_unhandled(admitted[i]);
+		}
+	}
+}
+
+void
+service_t::check_for_deadlined_limited_messages() {
+	cached_messages_deque_t expired;
+
+	{
+		boost::mutex::scoped_lock lock(m_limiter_mutex);
+
+		cached_messages_deque_t::iterator it = m_limiter_queue.begin();
+		while (it != m_limiter_queue.end()) {
+			if ((*it)->is_expired() && (*it)->is_deadlined()) {
+				expired.push_back(*it);
+				it = m_limiter_queue.erase(it);
+			}
+			else {
+				++it;
+			}
+		}
+	}
+
+	for (size_t i = 0; i < expired.size(); ++i) {
+		boost::shared_ptr<response_chunk_t> response(new response_chunk_t);
+		response->uuid = expired[i]->uuid();
+		response->rpc_code = SERVER_RPC_MESSAGE_ERROR;
+		response->error_code = deadline_error;
+		response->error_message = "message expired waiting for service concurrency limit";
+		enqueue_responce(response);
+	}
 }
 
 bool
@@ -187,6 +411,27 @@ service_t::enque_to_handle(const cached_message_prt_t& message) {
 	return true;
 }
 
+bool
+service_t::enque_to_handle(const std::string& handle_name, const messages_deque_ptr_t& queue) {
+	handles_map_t::iterator it = m_handles.find(handle_name);
+	if (it == m_handles.end()) {
+		return false;
+	}
+
+	handle_ptr_t handle = it->second;
+	assert(handle);
+	handle->assign_message_queue(queue);
+
+	if (log_flag_enabled(PLOG_DEBUG)) {
+		log(PLOG_DEBUG,
+			"enqued batch of %d msgs to existing handle %s",
+			queue->size(),
+			handle_name.c_str());
+	}
+
+	return true;
+}
+
 void
 service_t::enque_to_unhandled(const cached_message_prt_t& message) {
 	boost::mutex::scoped_lock lock(m_unhandled_mutex);
@@ -283,7 +528,7 @@ void
 service_t::get_outstanding_handles(const handles_endpoints_t& handles_endpoints,
 								   handles_info_list_t& outstanding_handles)
 {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	for (handles_map_t::iterator it = m_handles.begin(); it != m_handles.end(); ++it) {
 		const std::string& handle_name = it->first;
@@ -299,7 +544,7 @@ void
 service_t::get_new_handles(const handles_endpoints_t& handles_endpoints,
 						   handles_info_list_t& new_handles)
 {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::shared_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_endpoints_t::const_iterator it = handles_endpoints.begin();
 	for (; it != handles_endpoints.end(); ++it) {
@@ -315,12 +560,14 @@ service_t::get_new_handles(const handles_endpoints_t& handles_endpoints,
 
 void
 service_t::create_handle(const handle_info_t& handle_info, const std::set<cocaine_endpoint_t>& endpoints) {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
-
-	// create new handle
+	// create new handle, it waits for its dispatch thread to attach it,
+	// which might be finishing messages under shared lock right now,
+	// so handles lock is not held yet
 	handle_ptr_t handle(new dealer::handle_t(handle_info, endpoints, context()));
 	handle->set_responce_callback(boost::bind(&service_t::enqueue_responce, this, _1));
 
+	boost::unique_lock<boost::shared_mutex> lock(m_handles_mutex);
+
 	// retrieve unhandled queue
 	messages_deque_ptr_t queue = get_and_remove_unhandled_queue(handle_info.name);
 
@@ -344,7 +591,7 @@ service_t::create_handle(const handle_info_t& handle_info, const std::set<cocain
 
 void
 service_t::update_handle(const handle_info_t& handle_info, const std::set<cocaine_endpoint_t>& endpoints) {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::unique_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_map_t::iterator it = m_handles.find(handle_info.name);
 	if (it == m_handles.end()) {
@@ -362,7 +609,7 @@ service_t::update_handle(const handle_info_t& handle_info, const std::set<cocain
 
 void
 service_t::destroy_handle(const handle_info_t& info) {
-	boost::mutex::scoped_lock lock(m_handles_mutex);
+	boost::unique_lock<boost::shared_mutex> lock(m_handles_mutex);
 
 	handles_map_t::iterator it = m_handles.find(info.name);
 
@@ -374,9 +621,14 @@ service_t::destroy_handle(const handle_info_t& info) {
 	handle_ptr_t handle = it->second;
 	assert(handle);
 
+	// new messages for handle go to unhandled from now on
+	m_handles.erase(it);
+	lock.unlock();
+
 	log(PLOG_WARNING, "DESTROY HANDLE [%s]", info.name.c_str());
 
-	// retrieve message cache and terminate all handle activity
+	// retrieve message cache and terminate all handle activity, killing
+	// waits for dispatch thread, so handles lock must not be held here
 	handle->kill();
 
 	boost::shared_ptr<message_cache_t> mcache = handle->messages_cache();
@@ -395,14 +647,15 @@ service_t::destroy_handle(const handle_info_t& info) {
 
 	append_to_unhandled(info.name, handle_queue);
 
-	m_handles.erase(it);
-	lock.unlock();
-
 	log(PLOG_DEBUG, "DESTROY HANDLE [%s] DONE", info.name.c_str());
 }
 
 void
 service_t::check_for_deadlined_messages() {
+	if (m_limiter.get()) {
+		check_for_deadlined_limited_messages();
+	}
+
 	boost::mutex::scoped_lock lock(m_unhandled_mutex);
 
 	unhandled_messages_map_t::iterator it = m_unhandled_messages.begin();
@@ -0,0 +1,88 @@
+/*
+    Copyright (c) 2011-2012 Rim Zaidullin <creator@bash.org.ru>
+    Copyright (c) 2011-2012 Other contributors as noted in the AUTHORS file.
+
+    This file is part of Cocaine.
+
+    Cocaine is free software; you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    Cocaine is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with this program. If not, see <http://www.gnu.org/licenses/>. 
+*/
+
+#if defined(__linux__)
+	#include <sched.h>
+	#include <pthread.h>
+#endif
+
+#include "cocaine/dealer/utils/threading.hpp"
+
+namespace cocaine {
+namespace dealer {
+
+#if defined(__linux__)
+
+bool
+tutils::get_current_thread_affinity(std::vector<int>& cpus) {
+	cpus.clear();
+
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+
+	if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) {
+		return false;
+	}
+
+	for (int i = 0; i < CPU_SETSIZE; ++i) {
+		if (CPU_ISSET(i, &cpu_set)) {
+			cpus.push_back(i);
+		}
+	}
+
+	return true;
+}
+
+bool
+tutils::set_current_thread_affinity(const std::vector<int>& cpus) {
+	if (cpus.empty()) {
+		return true;
+	}
+
+	cpu_set_t cpu_set;
+	CPU_ZERO(&cpu_set);
+
+	for (size_t i = 0; i < cpus.size(); ++i) {
+		if (cpus[i] >= 0 && cpus[i] < CPU_SETSIZE) {
+			CPU_SET(cpus[i], &cpu_set);
+		}
+	}
+
+	return (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) == 0);
+}
+
+#else
+
+// thread affinity is not supported on this platform
+bool
+tutils::get_current_thread_affinity(std::vector<int>& cpus) {
+	cpus.clear();
+	return false;
+}
+
+bool
+tutils::set_current_thread_affinity(const std::vector<int>& cpus) {
+	return cpus.empty();
+}
+
+#endif
+
+} // namespace dealer
+} // namespace cocaine
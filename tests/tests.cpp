@@ -13,14 +13,32 @@
 
 #define BOOST_AUTO_TEST_MAIN
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
 #include <boost/mpl/list.hpp>
 #include <boost/test/auto_unit_test.hpp>
 #include <boost/test/unit_test.hpp>
 #include <boost/test/test_case_template.hpp>
 #include <boost/thread.hpp>
+#include <boost/lexical_cast.hpp>
 
 #include "details/time_value.hpp"
 
+#include "cocaine/dealer/future.hpp"
+#include "cocaine/dealer/core/context.hpp"
+#include "cocaine/dealer/core/balancer.hpp"
+#include "cocaine/dealer/core/cached_message.hpp"
+#include "cocaine/dealer/core/message_cache.hpp"
+#include "cocaine/dealer/core/request_metadata.hpp"
+#include "cocaine/dealer/core/sent_messages_index.hpp"
+#include "cocaine/dealer/utils/data_container.hpp"
+#include "cocaine/dealer/utils/time_value.hpp"
+
 typedef boost::mpl::list<int, long, unsigned char> test_types;
 
 BOOST_AUTO_TEST_SUITE(test_cached_read);
@@ -77,3 +95,324 @@ BOOST_AUTO_TEST_CASE_TEMPLATE(time_value_test5, T, test_types) {
 }
 
 BOOST_AUTO_TEST_SUITE_END();
+
+namespace cd = cocaine::dealer;
+
+namespace {
+	const std::string test_config_path = "../tests/config.json";
+
+	typedef cd::cached_message_t<cd::data_container, cd::request_metadata_t> test_message_t;
+
+	boost::shared_ptr<cd::message_iface> make_message(const cd::message_policy_t& policy = cd::message_policy_t()) {
+		static const std::string data = "test";
+		cd::message_path_t path("time echo", "time");
+
+		return boost::shared_ptr<cd::message_iface>(new test_message_t(path, policy, data.data(), data.size()));
+	}
+
+	std::set<cd::cocaine_endpoint_t> make_endpoints(const std::vector<double>& weights) {
+		std::set<cd::cocaine_endpoint_t> endpoints;
+
+		for (size_t i = 0; i < weights.size(); ++i) {
+			std::string port = boost::lexical_cast<std::string>(45000 + i);
+			std::string route = "route_" + boost::lexical_cast<std::string>(i);
+			endpoints.insert(cd::cocaine_endpoint_t("tcp://127.0.0.1:" + port, route, weights[i]));
+		}
+
+		return endpoints;
+	}
+
+	// route each of count messages is sent to
+	std::vector<std::string> send_messages(cd::balancer_t& balancer, size_t count) {
+		std::vector<std::string> routes;
+
+		for (size_t i = 0; i < count; ++i) {
+			boost::shared_ptr<cd::message_iface> message = make_message();
+			cd::cocaine_endpoint_t endpoint;
+			balancer.send(message, endpoint);
+			routes.push_back(endpoint.route);
+		}
+
+		return routes;
+	}
+}
+
+BOOST_AUTO_TEST_SUITE(test_sent_messages_index);
+
+BOOST_AUTO_TEST_CASE(sent_messages_index_insert_find_remove) {
+	cd::sent_messages_index_t index;
+	boost::shared_ptr<cd::message_iface> message = make_message();
+	boost::shared_ptr<cd::message_iface> found;
+
+	index.insert("a", message);
+	index.insert("b", message);
+
+	BOOST_CHECK_EQUAL(index.size(), 2);
+	BOOST_CHECK_EQUAL(index.count(message->uuid()), 2);
+	BOOST_CHECK_EQUAL(index.find(message->uuid(), "a", found), true);
+	BOOST_CHECK_EQUAL(found == message, true);
+	BOOST_CHECK_EQUAL(index.find(message->uuid(), "c", found), false);
+
+	// resending to the same route replaces entry
+	index.insert("a", message);
+	BOOST_CHECK_EQUAL(index.size(), 2);
+
+	BOOST_CHECK_EQUAL(index.remove(message->uuid(), "a", found), true);
+	BOOST_CHECK_EQUAL(index.remove(message->uuid(), "a", found), false);
+	BOOST_CHECK_EQUAL(index.count(message->uuid()), 1);
+	BOOST_CHECK_EQUAL(index.route_size("a"), 0);
+
+	BOOST_CHECK_EQUAL(index.remove_message(message), true);
+	BOOST_CHECK_EQUAL(index.remove_message(message), false);
+	BOOST_CHECK_EQUAL(index.size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(sent_messages_index_backward_shift) {
+	cd::sent_messages_index_t index;
+	std::vector<boost::shared_ptr<cd::message_iface> > messages;
+
+	// enough to grow the table several times and to get probe collisions
+	for (size_t i = 0; i < 1000; ++i) {
+		messages.push_back(make_message());
+		index.insert("a", messages.back());
+
+		if (i % 4 == 0) {
+			index.insert("b", messages.back());
+		}
+	}
+
+	BOOST_CHECK_EQUAL(index.size(), 1250);
+
+	boost::shared_ptr<cd::message_iface> found;
+
+	for (size_t i = 0; i < messages.size(); i += 2) {
+		BOOST_CHECK_EQUAL(index.remove(messages[i]->uuid(), "a", found), true);
+	}
+
+	// entries shifted back into erased slots must stay reachable
+	for (size_t i = 0; i < messages.size(); ++i) {
+		bool in_a = index.find(messages[i]->uuid(), "a", found);
+		BOOST_CHECK_EQUAL(in_a, i % 2 == 1);
+
+		if (in_a) {
+			BOOST_CHECK_EQUAL(found == messages[i], true);
+		}
+
+		BOOST_CHECK_EQUAL(index.find(messages[i]->uuid(), "b", found), i % 4 == 0);
+	}
+
+	BOOST_CHECK_EQUAL(index.route_size("a"), 500);
+	BOOST_CHECK_EQUAL(index.route_size("b"), 250);
+
+	cd::sent_messages_index_t::messages_list_t removed;
+	index.remove_route("b", removed);
+
+	BOOST_CHECK_EQUAL(removed.size(), 250);
+	BOOST_CHECK_EQUAL(index.size(), 500);
+
+	removed.clear();
+	index.remove_all(removed);
+
+	BOOST_CHECK_EQUAL(removed.size(), 500);
+	BOOST_CHECK_EQUAL(index.size(), 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+BOOST_AUTO_TEST_SUITE(test_balancer);
+
+BOOST_AUTO_TEST_CASE(balancer_smooth_weighted_round_robin) {
+	boost::shared_ptr<cd::context_t> ctx(new cd::context_t(test_config_path));
+
+	std::vector<double> weights;
+	weights.push_back(5.0);
+	weights.push_back(1.0);
+	weights.push_back(1.0);
+
+	cd::balancer_t balancer("test_balancer", make_endpoints(weights), ctx, 0, false);
+	std::vector<std::string> routes = send_messages(balancer, 70);
+
+	std::map<std::string, size_t> counts;
+	size_t max_run = 0;
+	size_t run = 0;
+
+	for (size_t i = 0; i < routes.size(); ++i) {
+		++counts[routes[i]];
+		run = (i > 0 && routes[i] == routes[i - 1]) ? run + 1 : 1;
+		max_run = std::max(max_run, run);
+	}
+
+	// picks are proportional to weights and heavy endpoint is interleaved
+	// with light ones, plain weighted round-robin sends 5 in a row
+	BOOST_CHECK_EQUAL(counts["route_0"], 50);
+	BOOST_CHECK_EQUAL(counts["route_1"], 10);
+	BOOST_CHECK_EQUAL(counts["route_2"], 10);
+	BOOST_CHECK_EQUAL(max_run < 5, true);
+}
+
+BOOST_AUTO_TEST_CASE(balancer_circuit_breaker_transitions) {
+	boost::shared_ptr<cd::context_t> ctx(new cd::context_t(test_config_path));
+
+	std::vector<double> weights(3, 1.0);
+	cd::balancer_t balancer("test_balancer", make_endpoints(weights), ctx, 0, false);
+
+	cd::wuuid_t uuid;
+	uuid.generate();
+
+	// closed -> open after consecutive failures
+	for (int i = 0; i < cd::defaults_t::circuit_failures_threshold; ++i) {
+		balancer.report_failure("route_0", uuid);
+	}
+
+	std::vector<std::string> routes = send_messages(balancer, 30);
+	BOOST_CHECK_EQUAL(std::count(routes.begin(), routes.end(), "route_0"), 0);
+	BOOST_CHECK_EQUAL(balancer.has_alive_endpoints(), true);
+
+	// open -> half open, single probe goes to ejected endpoint
+	boost::this_thread::sleep(boost::posix_time::milliseconds(
+		static_cast<long>(cd::defaults_t::circuit_ejection_time * 1000) + 100));
+
+	boost::shared_ptr<cd::message_iface> probe = make_message();
+	cd::cocaine_endpoint_t endpoint;
+	balancer.send(probe, endpoint);
+	BOOST_CHECK_EQUAL(endpoint.route, "route_0");
+
+	routes = send_messages(balancer, 30);
+	BOOST_CHECK_EQUAL(std::count(routes.begin(), routes.end(), "route_0"), 0);
+
+	// late replies to other messages don't decide, the probe does
+	balancer.report_success("route_0", uuid);
+	routes = send_messages(balancer, 30);
+	BOOST_CHECK_EQUAL(std::count(routes.begin(), routes.end(), "route_0"), 0);
+
+	// half open -> closed, back to its share of messages give or take
+	// the round-robin state it returns with
+	balancer.report_success("route_0", probe->uuid());
+	routes = send_messages(balancer, 30);
+
+	size_t probed_count = std::count(routes.begin(), routes.end(), "route_0");
+	BOOST_CHECK_EQUAL(probed_count >= 9 && probed_count <= 11, true);
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+BOOST_AUTO_TEST_SUITE(test_message_cache);
+
+BOOST_AUTO_TEST_CASE(message_cache_retry_backoff_bounds) {
+	boost::shared_ptr<cd::context_t> ctx(new cd::context_t(test_config_path));
+
+	cd::message_policy_t policy;
+	policy.retry_backoff = 0.1;
+	policy.retry_max_backoff = 0.4;
+	policy.retry_jitter = 0.5;
+
+	// expected delays before jitter for retries 1..5
+	const double delays[] = { 0.1, 0.2, 0.4, 0.4, 0.4 };
+	const double eps = 0.001;
+
+	for (int retries = 1; retries <= 5; ++retries) {
+		cd::message_cache_t cache(ctx, false);
+		boost::shared_ptr<cd::message_iface> message = make_message(policy);
+
+		for (int i = 0; i < retries; ++i) {
+			message->increment_retries_count();
+		}
+
+		double before = cd::time_value::get_current_time().as_double();
+		cache.schedule_retry(message, "route_0");
+		double after = cd::time_value::get_current_time().as_double();
+
+		double delay = delays[retries - 1];
+		double retry_time = cache.next_expiration_time();
+
+		BOOST_CHECK_EQUAL(retry_time - before <= delay + eps, true);
+		BOOST_CHECK_EQUAL(retry_time - after >= delay * (1.0 - policy.retry_jitter) - eps, true);
+		BOOST_CHECK_EQUAL(message->failed_routes().size(), 1);
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END();
+
+BOOST_AUTO_TEST_SUITE(test_future);
+
+BOOST_AUTO_TEST_CASE(future_when_all) {
+	std::vector<cd::promise_t<int> > promises(3);
+	std::vector<cd::future_t<int> > futures;
+
+	for (size_t i = 0; i < promises.size(); ++i) {
+		futures.push_back(promises[i].future());
+	}
+
+	cd::future_t<std::vector<int> > all = cd::when_all(futures);
+
+	promises[2].set_value(3);
+	promises[0].set_value(1);
+	BOOST_CHECK_EQUAL(all.ready(), false);
+
+	promises[1].set_value(2);
+	BOOST_CHECK_EQUAL(all.ready(), true);
+
+	// values keep order of futures, not of their completion
+	const std::vector<int>& values = all.get();
+	BOOST_CHECK_EQUAL(values.size(), 3);
+	BOOST_CHECK_EQUAL(values[0], 1);
+	BOOST_CHECK_EQUAL(values[1], 2);
+	BOOST_CHECK_EQUAL(values[2], 3);
+
+	// the second value is ignored
+	BOOST_CHECK_EQUAL(promises[0].set_value(10), false);
+	BOOST_CHECK_EQUAL(all.get()[0], 1);
+}
+
+BOOST_AUTO_TEST_CASE(future_when_any) {
+	std::vector<cd::promise_t<int> > promises(3);
+	std::vector<cd::future_t<int> > futures;
+
+	for (size_t i = 0; i < promises.size(); ++i) {
+		futures.push_back(promises[i].future());
+	}
+
+	cd::future_t<size_t> any = cd::when_any(futures);
+	BOOST_CHECK_EQUAL(any.ready(), false);
+
+	promises[1].set_value(2);
+	promises[0].set_value(1);
+
+	BOOST_CHECK_EQUAL(any.ready(), true);
+	BOOST_CHECK_EQUAL(any.get(), 1);
+
+	BOOST_CHECK_THROW(cd::when_any(std::vector<cd::future_t<int> >()), cd::internal_error);
+}
+
+namespace {
+	int throwing_continuation(const cd::future_t<int>&) {
+		throw std::runtime_error("continuation failed");
+	}
+
+	int doubling_continuation(const cd::future_t<int>& future) {
+		return future.get() * 2;
+	}
+}
+
+BOOST_AUTO_TEST_CASE(future_continuation_error) {
+	cd::promise_t<int> promise;
+
+	cd::future_t<int> failed = promise.future().then(&throwing_continuation);
+	cd::future_t<int> chained = failed.then(&doubling_continuation);
+	cd::future_t<int> doubled = promise.future().then(&doubling_continuation);
+
+	std::vector<cd::future_t<int> > futures;
+	futures.push_back(doubled);
+	futures.push_back(chained);
+	cd::future_t<std::vector<int> > all = cd::when_all(futures);
+
+	// error stays in chained futures, other continuations still run
+	BOOST_CHECK_EQUAL(promise.set_value(21), true);
+	BOOST_CHECK_EQUAL(doubled.get(), 42);
+	BOOST_CHECK_EQUAL(failed.has_error(), true);
+	BOOST_CHECK_EQUAL(chained.has_error(), true);
+	BOOST_CHECK_EQUAL(all.has_error(), true);
+	BOOST_CHECK_THROW(chained.get(), cd::internal_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END();